@@ -0,0 +1,268 @@
+#include "backup.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+// Device IDs reported in Flash ID mode, manufacturer in the low byte
+static const halfword FLASH64_ID  = 0xD4BF;  // SST
+static const halfword FLASH128_ID = 0x09C2;  // Macronix
+
+Backup::Backup()
+    : type(BACKUP_NONE), data(nullptr), size(0), fd(-1), dirty(false), large_rom(false) {
+    flash_state           = FLASH_READY;
+    flash_bank            = 0;
+    flash_id_mode         = false;
+    flash_erase           = false;
+    flash_program         = false;
+    flash_select          = false;
+    eeprom_bit_count      = 0;
+    eeprom_read_offset    = 0;
+    eeprom_read_remaining = 0;
+}
+
+Backup::~Backup() {
+    close();
+}
+
+// The save library linked into the game leaves its name and version in the ROM
+BACKUP_TYPE Backup::detect(const byte* rom, size_t rom_size) {
+    static const std::pair<const char*, BACKUP_TYPE> signatures[] = {
+        {"EEPROM_V", BACKUP_EEPROM},
+        {"SRAM_V", BACKUP_SRAM},
+        {"SRAM_F_V", BACKUP_SRAM},
+        {"FLASH_V", BACKUP_FLASH64},
+        {"FLASH512_V", BACKUP_FLASH64},
+        {"FLASH1M_V", BACKUP_FLASH128},
+    };
+    const char* begin = reinterpret_cast<const char*>(rom);
+    for (auto& signature : signatures) {
+        size_t length = std::strlen(signature.first);
+        if (std::search(begin, begin + rom_size, signature.first, signature.first + length) != begin + rom_size) {
+            return signature.second;
+        }
+    }
+    return BACKUP_NONE;
+}
+
+// Maps filename, creating it erased (0xFF) when it does not exist or is too short. Without a filename
+// the save is an erased anonymous mapping, which never touches the disk
+bool Backup::open(std::string filename, BACKUP_TYPE _type, bool _large_rom) {
+    close();
+    switch (_type) {
+        case BACKUP_SRAM:
+            size = SRAM_SIZE;
+            break;
+        case BACKUP_FLASH64:
+            size = FLASH_BANK;
+            break;
+        case BACKUP_FLASH128:
+            size = FLASH_BANK * 2;
+            break;
+        case BACKUP_EEPROM:
+            size = EEPROM_SIZE;
+            break;
+        default:
+            return false;
+    }
+    if (filename.empty()) {
+        void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) return false;
+        data      = static_cast<byte*>(mapping);
+        type      = _type;
+        large_rom = _large_rom;
+        std::fill(data, data + size, 0xFF);
+        return true;
+    }
+    fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close();
+        return false;
+    }
+    size_t existing = st.st_size;
+    if (existing < size && ftruncate(fd, size) != 0) {
+        close();
+        return false;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close();
+        return false;
+    }
+    data      = static_cast<byte*>(mapping);
+    type      = _type;
+    large_rom = _large_rom;
+    if (existing < size) {
+        std::fill(data + existing, data + size, 0xFF);
+        flush(true);
+    }
+    return true;
+}
+
+void Backup::close() {
+    if (data != nullptr) {
+        flush(true);
+        munmap(data, size);
+        data = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    type = BACKUP_NONE;
+}
+
+// The contents are part of the state, loading one overwrites the save file
+void Backup::sync_state(Savestate& state) {
+    if (data != nullptr) state.sync_bytes(data, size);
+    state.sync(flash_state);
+    state.sync(flash_bank);
+    state.sync(flash_id_mode);
+    state.sync(flash_erase);
+    state.sync(flash_program);
+    state.sync(flash_select);
+    state.sync_bytes(eeprom_bits, sizeof(eeprom_bits));
+    state.sync(eeprom_bit_count);
+    state.sync(eeprom_read_offset);
+    state.sync(eeprom_read_remaining);
+    if (state.is_loading()) dirty = true;
+}
+
+// Asynchronous flushes only schedule the write back of the dirty pages, synchronous ones wait for it.
+// A failed flush leaves the save dirty so the next one tries again
+bool Backup::flush(bool sync) {
+    if (data == nullptr || fd < 0 || (!dirty && !sync)) return true;
+    if (msync(data, size, sync ? MS_SYNC : MS_ASYNC) != 0) return false;
+    dirty = false;
+    return true;
+}
+
+// https://problemkaputt.de/gbatek.htm#gbacartbackupsramfram
+// SRAM and Flash sit on an 8 bit bus, wider accesses are done by Memory one byte at a time
+byte Backup::read_byte(size_t index) {
+    size_t offset = index & 0xFFFF;
+    if (type == BACKUP_SRAM) return data[offset & (SRAM_SIZE - 1)];
+    if (flash_id_mode && offset < 2) {
+        halfword id = type == BACKUP_FLASH128 ? FLASH128_ID : FLASH64_ID;
+        return id >> (offset * 8);
+    }
+    return data[flash_bank * FLASH_BANK + offset];
+}
+
+void Backup::write_byte(size_t index, byte value) {
+    size_t offset = index & 0xFFFF;
+    if (type == BACKUP_SRAM) {
+        data[offset & (SRAM_SIZE - 1)] = value;
+        dirty                          = true;
+    } else {
+        flash_write(offset, value);
+    }
+}
+
+// https://problemkaputt.de/gbatek.htm#gbacartbackupflashrom
+void Backup::flash_write(size_t offset, byte value) {
+    if (flash_program) {
+        data[flash_bank * FLASH_BANK + offset] = value;
+        dirty                                  = true;
+        flash_program                          = false;
+        return;
+    }
+    if (flash_select) {
+        if (offset == 0 && type == BACKUP_FLASH128) flash_bank = value & 1;
+        flash_select = false;
+        return;
+    }
+    switch (flash_state) {
+        case FLASH_READY:
+            if (offset == 0x5555 && value == 0xAA) flash_state = FLASH_COMMAND_1;
+            return;
+        case FLASH_COMMAND_1:
+            flash_state = (offset == 0x2AAA && value == 0x55) ? FLASH_COMMAND_2 : FLASH_READY;
+            return;
+        case FLASH_COMMAND_2:
+            break;
+    }
+    flash_state = FLASH_READY;
+    if (flash_erase) {
+        flash_erase = false;
+        if (offset == 0x5555 && value == 0x10) {
+            std::fill(data, data + size, 0xFF);
+            dirty = true;
+        } else if (value == 0x30) {
+            byte* sector = data + flash_bank * FLASH_BANK + (offset & 0xF000);
+            std::fill(sector, sector + 0x1000, 0xFF);
+            dirty = true;
+        }
+        return;
+    }
+    if (offset != 0x5555) return;
+    switch (value) {
+        case 0x90:
+            flash_id_mode = true;
+            break;
+        case 0xF0:
+            flash_id_mode = false;
+            break;
+        case 0x80:
+            flash_erase = true;
+            break;
+        case 0xA0:
+            flash_program = true;
+            break;
+        case 0xB0:
+            flash_select = true;
+            break;
+    }
+}
+
+// https://problemkaputt.de/gbatek.htm#gbacartbackupeeprom
+// Requests are written one bit per halfword, usually by DMA 3. Their length tells the EEPROM size apart:
+// read requests are 9 or 17 bits long and writes 73 or 81 bits, for 6 or 14 bit addresses. A request is
+// run when the game starts reading the answer or the ready bit.
+void Backup::eeprom_write(halfword value) {
+    eeprom_bits[eeprom_bit_count++] = value & 1;
+    if (eeprom_bit_count == 81) eeprom_command();
+}
+
+halfword Backup::eeprom_read() {
+    if (eeprom_bit_count > 0) eeprom_command();
+    if (eeprom_read_remaining == 0) return 1;  // ready
+    int bit = 68 - eeprom_read_remaining--;
+    if (bit < 4) return 0;  // 4 junk bits before the data
+    bit -= 4;
+    return (data[eeprom_read_offset + bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+void Backup::eeprom_command() {
+    int count        = eeprom_bit_count;
+    eeprom_bit_count = 0;
+    bool read        = count == 9 || count == 17;
+    bool write       = count == 73 || count == 81;
+    if (!read && !write) return;
+    int address_bits = read ? count - 3 : count - 67;
+    if (eeprom_bits[0] != 1 || eeprom_bits[1] != (read ? 1 : 0)) return;
+    size_t address = 0;
+    for (int i = 0; i < address_bits; i++) {
+        address = (address << 1) | eeprom_bits[2 + i];
+    }
+    size_t offset = (address & 0x3FF) * 8;
+    if (read) {
+        eeprom_read_offset    = offset;
+        eeprom_read_remaining = 68;
+        return;
+    }
+    for (int i = 0; i < 8; i++) {
+        byte value = 0;
+        for (int b = 0; b < 8; b++) {
+            value = (value << 1) | eeprom_bits[2 + address_bits + i * 8 + b];
+        }
+        data[offset + i] = value;
+    }
+    dirty = true;
+}
@@ -0,0 +1,78 @@
+#ifndef BACKUP_H
+#define BACKUP_H
+
+// https://problemkaputt.de/gbatek.htm#gbacartbackupids
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "savestate.h"
+#include "utils.h"
+
+typedef enum {
+    BACKUP_NONE,
+    BACKUP_SRAM,      // 32KB battery backed RAM
+    BACKUP_FLASH64,   // 64KB Flash
+    BACKUP_FLASH128,  // 128KB Flash, in two 64KB banks
+    BACKUP_EEPROM     // 512B or 8KB serial EEPROM, in the upper ROM area
+} BACKUP_TYPE;
+
+static const int SRAM_SIZE   = 0x8000;
+static const int FLASH_BANK  = 0x10000;
+static const int EEPROM_SIZE = 0x2000;
+
+typedef enum {
+    FLASH_READY,
+    FLASH_COMMAND_1,  // 0xAA written to 0x5555
+    FLASH_COMMAND_2   // then 0x55 to 0x2AAA, the command byte goes to 0x5555
+} FLASH_STATE;
+
+// Cartridge save memory, backed by a memory mapped .sav file. Writes only touch the mapping, the kernel
+// writes the dirty pages back and flush() asks for it explicitly, so saving costs no I/O on the emulation
+// thread and the file always holds the latest contents even if the emulator is killed.
+class Backup {
+    private:
+    BACKUP_TYPE type;
+    byte* data;
+    size_t size;
+    int fd;
+    bool dirty;
+    bool large_rom;  // ROMs over 16MB leave only 0xDFFFF00-0xDFFFFFF to the EEPROM
+
+    FLASH_STATE flash_state;
+    int flash_bank;
+    bool flash_id_mode;
+    bool flash_erase;    // 0x80 received, the next command erases
+    bool flash_program;  // 0xA0 received, the next write programs a byte
+    bool flash_select;   // 0xB0 received, the next write to 0x0000 selects the bank
+
+    byte eeprom_bits[81];  // longest request: 2 command bits, 14 address bits, 64 data bits and a stop bit
+    int eeprom_bit_count;
+    size_t eeprom_read_offset;
+    int eeprom_read_remaining;
+
+    void flash_write(size_t offset, byte value);
+    void eeprom_command();
+
+    public:
+    Backup();
+    ~Backup();
+    static BACKUP_TYPE detect(const byte* rom, size_t rom_size);
+    bool open(std::string filename, BACKUP_TYPE type, bool large_rom);
+    void close();
+    bool flush(bool sync);
+    void sync_state(Savestate& state);
+    BACKUP_TYPE get_type() {
+        return type;
+    }
+    bool maps(size_t index) {
+        if ((index >> 24) == 0x0E) return type != BACKUP_NONE && type != BACKUP_EEPROM;
+        return type == BACKUP_EEPROM && (index >> 24) == 0x0D && (!large_rom || index >= 0x0DFFFF00);
+    }
+    byte read_byte(size_t index);
+    void write_byte(size_t index, byte value);
+    halfword eeprom_read();
+    void eeprom_write(halfword value);
+};
+
+#endif
@@ -0,0 +1,420 @@
+#include "bios.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "profiler.h"
+
+// Same code as the BIOS IRQ handler, at the same addresses
+static const word irq_handler[] = {
+    0xE92D500F,  // stmfd sp!, {r0-r3, r12, lr}
+    0xE3A00301,  // mov r0, #0x04000000
+    0xE28FE000,  // add lr, pc, #0
+    0xE510F004,  // ldr pc, [r0, #-4]
+    0xE8BD500F,  // ldmfd sp!, {r0-r3, r12, lr}
+    0xE25EF004   // subs pc, lr, #4
+};
+
+BIOS::BIOS(Memory& _mem)
+    : mem(_mem) {
+    size_t available;
+    byte* rom                                       = mem.get_pointer(SYS_ROM_START, available);
+    *reinterpret_cast<word*>(rom + BIOS_IRQ_VECTOR) = 0xEA000000 | ((BIOS_IRQ_HANDLER - BIOS_IRQ_VECTOR - 8) >> 2);
+    std::memcpy(rom + BIOS_IRQ_HANDLER, irq_handler, sizeof(irq_handler));
+    // same values as the 1.14 fixed point sine table of the BIOS
+    for (int i = 0; i < 256; i++) {
+        sin_table[i] = std::lround(std::sin(i * M_PI / 128) * 0x4000);
+    }
+}
+
+bool BIOS::handles(int number) {
+    switch (number) {
+        case SWI_DIV:
+        case SWI_DIV_ARM:
+        case SWI_SQRT:
+        case SWI_ARCTAN:
+        case SWI_ARCTAN2:
+        case SWI_CPU_SET:
+        case SWI_CPU_FAST_SET:
+        case SWI_GET_BIOS_CHECKSUM:
+        case SWI_BG_AFFINE_SET:
+        case SWI_OBJ_AFFINE_SET:
+        case SWI_LZ77_UNCOMP_WRAM:
+        case SWI_LZ77_UNCOMP_VRAM:
+        case SWI_HUFF_UNCOMP:
+        case SWI_RL_UNCOMP_WRAM:
+        case SWI_RL_UNCOMP_VRAM:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Arguments and results are passed in r0-r3 like with the real BIOS
+int BIOS::call(int number, word& r0, word& r1, word& r2, word& r3) {
+    ScopedTimer timer(BIOS_HLE);
+    switch (number) {
+        case SWI_DIV:
+            return div(r0, r1, r3);
+        case SWI_DIV_ARM:
+            std::swap(r0, r1);
+            return div(r0, r1, r3) + 4;
+        case SWI_SQRT:
+            return sqrt(r0);
+        case SWI_ARCTAN:
+            return arctan(r0);
+        case SWI_ARCTAN2:
+            return arctan2(r0, r1);
+        case SWI_CPU_SET:
+            return cpu_set(r0, r1, r2, false);
+        case SWI_CPU_FAST_SET:
+            return cpu_set(r0, r1, r2, true);
+        case SWI_GET_BIOS_CHECKSUM:
+            r0 = 0xBAAE187F;  // GBA BIOS
+            return 20;
+        case SWI_BG_AFFINE_SET:
+            return bg_affine_set(r0, r1, r2);
+        case SWI_OBJ_AFFINE_SET:
+            return obj_affine_set(r0, r1, r2, r3);
+        case SWI_LZ77_UNCOMP_WRAM:
+        case SWI_LZ77_UNCOMP_VRAM:
+            return lz77_uncomp(r0, r1, number == SWI_LZ77_UNCOMP_VRAM);
+        case SWI_HUFF_UNCOMP:
+            return huff_uncomp(r0, r1);
+        case SWI_RL_UNCOMP_WRAM:
+        case SWI_RL_UNCOMP_VRAM:
+            return rl_uncomp(r0, r1, number == SWI_RL_UNCOMP_VRAM);
+        default:
+            log_warning("Unimplemented HLE SWI");
+            return 1;
+    }
+}
+
+// https://problemkaputt.de/gbatek.htm#biosinterruptfunctions
+// One check of the IntrWait loop: enables IME, then returns true and acknowledges the flags once the
+// user handler has set one of them in the BIOS IF. The CPU halts and checks again otherwise.
+bool BIOS::intr_wait(bool discard, word flags) {
+    mem.io_halfword(IME) = 1;
+    halfword bios_if     = mem.get_halfword(BIOS_IF_ADDRESS);
+    if (discard) bios_if &= ~flags;
+    bool done = bios_if & flags;
+    mem.set_halfword(BIOS_IF_ADDRESS, bios_if & ~flags);
+    return done;
+}
+
+// https://problemkaputt.de/gbatek.htm#biosarithmeticfunctions
+int BIOS::div(word& r0, word& r1, word& r3) {
+    int64_t numerator   = static_cast<int32_t>(r0);
+    int64_t denominator = static_cast<int32_t>(r1);
+    if (denominator == 0) {
+        // the BIOS never returns from a division by zero on hardware, keep it sane here
+        r0 = numerator < 0 ? -1 : 1;
+        r1 = numerator;
+        r3 = 1;
+        return 20;
+    }
+    int64_t quotient = numerator / denominator;
+    r0               = static_cast<word>(quotient);
+    r1               = static_cast<word>(numerator % denominator);
+    r3               = static_cast<word>(quotient < 0 ? -quotient : quotient);
+    return 40;
+}
+
+int BIOS::sqrt(word& r0) {
+    word value  = r0;
+    word result = 0;
+    word bit    = 1u << 30;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    r0 = result;
+    return 50;
+}
+
+// Same polynomial approximation as the BIOS, so results match bit for bit
+static int32_t arctan_polynomial(int32_t tan) {
+    int32_t a = -((tan * tan) >> 14);
+    int32_t b = ((0xA9 * a) >> 14) + 0x390;
+    b         = ((b * a) >> 14) + 0x91C;
+    b         = ((b * a) >> 14) + 0xFB6;
+    b         = ((b * a) >> 14) + 0x16AA;
+    b         = ((b * a) >> 14) + 0x2081;
+    b         = ((b * a) >> 14) + 0x3651;
+    b         = ((b * a) >> 14) + 0xA2F9;
+    return (tan * b) >> 16;
+}
+
+int BIOS::arctan(word& r0) {
+    r0 = static_cast<word>(arctan_polynomial(static_cast<int16_t>(r0)));
+    return 40;
+}
+
+// Full circle angle of (x, y) as 0x0000-0xFFFF
+int BIOS::arctan2(word& r0, word r1) {
+    int32_t x = static_cast<int16_t>(r0);
+    int32_t y = static_cast<int16_t>(r1);
+    int32_t angle;
+    if (y == 0) {
+        angle = x >= 0 ? 0 : 0x8000;
+    } else if (x == 0) {
+        angle = y >= 0 ? 0x4000 : 0xC000;
+    } else if (y >= 0) {
+        if (x >= 0 && x >= y) {
+            angle = arctan_polynomial((y << 14) / x);
+        } else if (x < 0 && -x >= y) {
+            angle = arctan_polynomial((y << 14) / x) + 0x8000;
+        } else {
+            angle = 0x4000 - arctan_polynomial((x << 14) / y);
+        }
+    } else {
+        if (x <= 0 && -x > -y) {
+            angle = arctan_polynomial((y << 14) / x) + 0x8000;
+        } else if (x > 0 && x >= -y) {
+            angle = arctan_polynomial((y << 14) / x) + 0x10000;
+        } else {
+            angle = 0xC000 - arctan_polynomial((x << 14) / y);
+        }
+    }
+    r0 = static_cast<halfword>(angle);
+    return 60;
+}
+
+// https://problemkaputt.de/gbatek.htm#biosmemorycopy
+// Copies or fills straight between the backing arrays when both ranges are plain memory and do not
+// overlap forward, otherwise goes through Memory in the same order as the BIOS
+int BIOS::cpu_set(word source, word dest, word control, bool fast) {
+    bool fill  = control & (1 << 24);
+    int unit   = (fast || (control & (1 << 26))) ? 4 : 2;
+    word count = control & 0x1FFFFF;
+    if (fast) count = (count + 7) & ~7;
+    source &= ~(unit - 1);
+    dest &= ~(unit - 1);
+    word bytes = count * unit;
+
+    size_t source_available, dest_available;
+    byte* src = mem.get_plain_pointer(source, source_available, false);
+    byte* dst = mem.get_plain_pointer(dest, dest_available, true);
+    // the BIOS copies forward, a destination starting inside the source reads back what it has written
+    bool overlap = !fill && dst > src && dst < src + bytes;
+    if (src != nullptr && dst != nullptr && source_available >= (fill ? unit : bytes) && dest_available >= bytes && !overlap) {
+        if (!fill) {
+            std::memmove(dst, src, bytes);
+        } else if (unit == 4) {
+            std::fill_n(reinterpret_cast<word*>(dst), count, *reinterpret_cast<word*>(src));
+        } else {
+            std::fill_n(reinterpret_cast<halfword*>(dst), count, *reinterpret_cast<halfword*>(src));
+        }
+        mem.mark_video_dirty(dest, bytes);
+    } else {
+        // CpuFastSet moves eight words per LDM/STM pair
+        int block = fast ? 8 : 1;
+        word values[8];
+        for (word i = 0; i < count; i += block) {
+            for (int j = 0; j < block; j++) {
+                word from = fill ? source : source + (i + j) * unit;
+                values[j] = unit == 4 ? mem.get_word(from) : mem.get_halfword(from);
+            }
+            for (int j = 0; j < block; j++) {
+                if (unit == 4) {
+                    mem.set_word(dest + (i + j) * unit, values[j]);
+                } else {
+                    mem.set_halfword(dest + (i + j) * unit, values[j]);
+                }
+            }
+        }
+    }
+    int per_unit = mem.access_cycles(source, unit, true) + mem.access_cycles(dest, unit, true);
+    return 40 + count * (fast ? per_unit : per_unit + 3);
+}
+
+// https://problemkaputt.de/gbatek.htm#biosrotationscalingfunctions
+int BIOS::bg_affine_set(word source, word dest, word count) {
+    for (word i = 0; i < count; i++, source += 20, dest += 16) {
+        int32_t origin_x  = mem.get_word(source);
+        int32_t origin_y  = mem.get_word(source + 4);
+        int32_t display_x = static_cast<int16_t>(mem.get_halfword(source + 8));
+        int32_t display_y = static_cast<int16_t>(mem.get_halfword(source + 10));
+        int32_t scale_x   = static_cast<int16_t>(mem.get_halfword(source + 12));
+        int32_t scale_y   = static_cast<int16_t>(mem.get_halfword(source + 14));
+        int angle         = mem.get_halfword(source + 16) >> 8;
+        int32_t sin       = sin_table[angle];
+        int32_t cos       = sin_table[(angle + 64) & 0xFF];
+        int32_t pa        = (scale_x * cos) >> 14;
+        int32_t pb        = -((scale_x * sin) >> 14);
+        int32_t pc        = (scale_y * sin) >> 14;
+        int32_t pd        = (scale_y * cos) >> 14;
+        mem.set_halfword(dest, pa);
+        mem.set_halfword(dest + 2, pb);
+        mem.set_halfword(dest + 4, pc);
+        mem.set_halfword(dest + 6, pd);
+        mem.set_word(dest + 8, origin_x - (pa * display_x + pb * display_y));
+        mem.set_word(dest + 12, origin_y - (pc * display_x + pd * display_y));
+    }
+    return 50 + count * 60;
+}
+
+int BIOS::obj_affine_set(word source, word dest, word count, word offset) {
+    for (word i = 0; i < count; i++, source += 8, dest += offset * 4) {
+        int32_t scale_x = static_cast<int16_t>(mem.get_halfword(source));
+        int32_t scale_y = static_cast<int16_t>(mem.get_halfword(source + 2));
+        int angle       = mem.get_halfword(source + 4) >> 8;
+        int32_t sin     = sin_table[angle];
+        int32_t cos     = sin_table[(angle + 64) & 0xFF];
+        mem.set_halfword(dest, (scale_x * cos) >> 14);
+        mem.set_halfword(dest + offset, -((scale_x * sin) >> 14));
+        mem.set_halfword(dest + offset * 2, (scale_y * sin) >> 14);
+        mem.set_halfword(dest + offset * 3, (scale_y * cos) >> 14);
+    }
+    return 50 + count * 40;
+}
+
+byte BIOS::read_byte(word address) {
+    return mem[address];
+}
+
+// Writes the decompressed buffer at dest, in one copy when dest is plain memory. The VRAM variants
+// only differ by writing halfwords, which gives the same result here.
+int BIOS::write_buffer(word dest, bool vram) {
+    word bytes = buffer.size();
+    size_t available;
+    byte* dst = mem.get_plain_pointer(dest, available, true);
+    if (dst != nullptr && available >= bytes) {
+        std::memcpy(dst, buffer.data(), bytes);
+        mem.mark_video_dirty(dest, bytes);
+    } else if (vram) {
+        for (word i = 0; i + 1 < bytes; i += 2) {
+            mem.set_halfword(dest + i, buffer[i] | buffer[i + 1] << 8);
+        }
+    } else {
+        for (word i = 0; i < bytes; i++) {
+            mem.set_byte(dest + i, buffer[i]);
+        }
+    }
+    return 100 + bytes * (vram ? 8 : 6);
+}
+
+// https://problemkaputt.de/gbatek.htm#biosdecompressionfunctions
+int BIOS::lz77_uncomp(word source, word dest, bool vram) {
+    word header = mem.get_word(source);
+    word size   = header >> 8;
+    buffer.clear();
+    buffer.reserve(size);
+    size_t available;
+    const byte* src = mem.get_plain_pointer(source, available, false);
+    word position   = 4;
+    auto next       = [&]() -> byte {
+        byte value = (src != nullptr && position < available) ? src[position] : read_byte(source + position);
+        position++;
+        return value;
+    };
+    while (buffer.size() < size) {
+        byte flags = next();
+        for (int i = 0; i < 8 && buffer.size() < size; i++, flags <<= 1) {
+            if (!(flags & 0x80)) {
+                buffer.push_back(next());
+                continue;
+            }
+            byte b0        = next();
+            byte b1        = next();
+            size_t length  = (b0 >> 4) + 3;
+            size_t disp    = (((b0 & 0xF) << 8) | b1) + 1;
+            size_t start   = buffer.size();
+            if (disp > start) disp = start == 0 ? 1 : start;
+            length = std::min<size_t>(length, size - start);
+            buffer.resize(start + length);
+            if (start == 0) continue;
+            if (disp >= length) {
+                std::memcpy(buffer.data() + start, buffer.data() + start - disp, length);
+            } else {
+                // overlapping references repeat the last disp bytes
+                for (size_t j = 0; j < length; j++) {
+                    buffer[start + j] = buffer[start + j - disp];
+                }
+            }
+        }
+    }
+    return write_buffer(dest, vram);
+}
+
+int BIOS::rl_uncomp(word source, word dest, bool vram) {
+    word header = mem.get_word(source);
+    word size   = header >> 8;
+    buffer.clear();
+    buffer.reserve(size);
+    size_t available;
+    const byte* src = mem.get_plain_pointer(source, available, false);
+    word position   = 4;
+    auto next       = [&]() -> byte {
+        byte value = (src != nullptr && position < available) ? src[position] : read_byte(source + position);
+        position++;
+        return value;
+    };
+    while (buffer.size() < size) {
+        byte flag     = next();
+        size_t length = std::min<size_t>(flag & 0x80 ? (flag & 0x7F) + 3 : (flag & 0x7F) + 1, size - buffer.size());
+        if (flag & 0x80) {
+            buffer.insert(buffer.end(), length, next());
+        } else {
+            for (size_t j = 0; j < length; j++) {
+                buffer.push_back(next());
+            }
+        }
+    }
+    return write_buffer(dest, vram);
+}
+
+// The tree nodes hold a 6 bit offset to their children, bits 7 and 6 flag the children as data
+int BIOS::huff_uncomp(word source, word dest) {
+    word header  = mem.get_word(source);
+    int bits     = header & 0xF;
+    word size    = header >> 8;
+    word tree    = source + 4;
+    word root    = tree + 1;
+    word stream  = tree + (read_byte(tree) + 1) * 2;
+    word node_at = root;
+    byte node    = read_byte(root);
+    word output  = 0;
+    int shift    = 0;
+    buffer.clear();
+    buffer.reserve(size + 4);
+    if (bits != 4 && bits != 8) {
+        log_warning("Invalid HuffUnComp data size");
+        return 100;
+    }
+    while (buffer.size() < size) {
+        word data = mem.get_word(stream);
+        stream += 4;
+        for (int i = 31; i >= 0 && buffer.size() < size; i--) {
+            int bit   = (data >> i) & 1;
+            word next = (node_at & ~1) + (node & 0x3F) * 2 + 2 + bit;
+            if (!(node & (bit ? 0x40 : 0x80))) {
+                node_at = next;
+                node    = read_byte(next);
+                continue;
+            }
+            output |= (read_byte(next) & ((1 << bits) - 1)) << shift;
+            shift += bits;
+            if (shift == 32) {
+                for (int j = 0; j < 4; j++) {
+                    buffer.push_back(output >> (j * 8));
+                }
+                output = 0;
+                shift  = 0;
+            }
+            node_at = root;
+            node    = read_byte(root);
+        }
+    }
+    buffer.resize(size);
+    return write_buffer(dest, true);
+}
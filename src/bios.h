@@ -0,0 +1,71 @@
+#ifndef BIOS_H
+#define BIOS_H
+
+// https://problemkaputt.de/gbatek.htm#biosfunctions
+#include <cstdint>
+#include <vector>
+
+#include "memory.h"
+#include "utils.h"
+
+typedef enum {
+    SWI_SOFT_RESET          = 0x00,
+    SWI_REGISTER_RAM_RESET  = 0x01,
+    SWI_HALT                = 0x02,
+    SWI_STOP                = 0x03,
+    SWI_INTR_WAIT           = 0x04,
+    SWI_VBLANK_INTR_WAIT    = 0x05,
+    SWI_DIV                 = 0x06,
+    SWI_DIV_ARM             = 0x07,
+    SWI_SQRT                = 0x08,
+    SWI_ARCTAN              = 0x09,
+    SWI_ARCTAN2             = 0x0A,
+    SWI_CPU_SET             = 0x0B,
+    SWI_CPU_FAST_SET        = 0x0C,
+    SWI_GET_BIOS_CHECKSUM   = 0x0D,
+    SWI_BG_AFFINE_SET       = 0x0E,
+    SWI_OBJ_AFFINE_SET      = 0x0F,
+    SWI_LZ77_UNCOMP_WRAM    = 0x11,
+    SWI_LZ77_UNCOMP_VRAM    = 0x12,
+    SWI_HUFF_UNCOMP         = 0x13,
+    SWI_RL_UNCOMP_WRAM      = 0x14,
+    SWI_RL_UNCOMP_VRAM      = 0x15
+} SWI;
+
+// The IRQ handler of the BIOS saves r0-r3, r12 and lr on the IRQ stack, calls the user handler stored at
+// IRQ_HANDLER_ADDRESS, then returns from BIOS_IRQ_RETURN
+static const word BIOS_IRQ_VECTOR     = 0x18;
+static const word BIOS_IRQ_HANDLER    = 0x128;
+static const word BIOS_IRQ_RETURN     = 0x138;
+static const word IRQ_HANDLER_ADDRESS = 0x03FFFFFC;
+static const word BIOS_IF_ADDRESS     = 0x03FFFFF8;  // interrupts acknowledged by the user handler, for IntrWait
+
+// High level emulation of the BIOS calls, serviced natively instead of running the BIOS code.
+// Each call returns an approximation of the cycles the real BIOS would take.
+class BIOS {
+    private:
+    Memory& mem;
+    int16_t sin_table[256];
+    std::vector<byte> buffer;  // decompression output
+
+    int div(word& r0, word& r1, word& r3);
+    int sqrt(word& r0);
+    int arctan(word& r0);
+    int arctan2(word& r0, word r1);
+    int cpu_set(word source, word dest, word control, bool fast);
+    int bg_affine_set(word source, word dest, word count);
+    int obj_affine_set(word source, word dest, word count, word offset);
+    int lz77_uncomp(word source, word dest, bool vram);
+    int huff_uncomp(word source, word dest);
+    int rl_uncomp(word source, word dest, bool vram);
+    int write_buffer(word dest, bool vram);
+    byte read_byte(word address);
+
+    public:
+    BIOS(Memory& mem);
+    bool handles(int number);
+    bool intr_wait(bool discard, word flags);
+    int call(int number, word& r0, word& r1, word& r2, word& r3);
+};
+
+#endif
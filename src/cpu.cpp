@@ -5,7 +5,9 @@
 #include <iostream>
 #include <functional>
 
+#include "interrupts.h"
 #include "memory.h"
+#include "profiler.h"
 #include "utils.h"
 
 inline bool is_bit_set(word x, int offset) {
@@ -24,30 +26,164 @@ inline word rotate_right(word value, int rotate_amount) {
 
 CPU::CPU(Memory& _mem)
     : mem(_mem) {
-    PC = PAK_ROM_WAIT_STATE_0_START;
-    state         = ARM_CODE;
+    for (int m = 0; m < 6; m++) {
+        for (int r = 0; r < 16; r++) {
+            *reg[m][r] = 0;
+        }
+        *PSR[m] = 0;
+    }
+    // state left by the BIOS boot sequence, in system mode which shares the user registers
+    mode    = USR;
+    CPSR    = 0x1F;
+    r13     = 0x03007F00;
+    irq_r13 = 0x03007FA0;
+    svc_r13 = 0x03007FE0;
+    PC      = PAK_ROM_WAIT_STATE_0_START;
+    state    = ARM_CODE;
+    cycles   = 0;
+    hle_bios     = nullptr;
+    interrupts   = nullptr;
+    halted       = false;
+    intr_waiting = false;
+    reset_idle_detection();
 }
 
 CPU::~CPU() {
 }
 
-void CPU::run() {
+// Every physical register once: the user bank, the FIQ bank, then r13 and r14 of the other modes
+void CPU::sync_state(Savestate& state) {
+    state.sync(this->state);
+    state.sync(mode);
+    for (int r = 0; r < 16; r++) {
+        state.sync(*reg[USR][r]);
+    }
+    for (int r = 8; r < 15; r++) {
+        state.sync(*reg[FIQ][r]);
+    }
+    for (int m = IRQ; m <= UND; m++) {
+        state.sync(*reg[m][13]);
+        state.sync(*reg[m][14]);
+    }
+    for (int m = 0; m < 6; m++) {
+        state.sync(*PSR[m]);
+    }
+    state.sync(halted);
+    state.sync(intr_waiting);
+    state.sync(idle_loop);
+    state.sync(idle_branch);
+    for (int r = 0; r < 16; r++) {
+        state.sync(idle_regs[r]);
+    }
+    state.sync(idle_cpsr);
+    state.sync(idle_write_count);
+}
+
+// Executes a single instruction and returns the number of cycles it took. PC is advanced past the
+// instruction before it executes
+int CPU::run() {
     word arm_instruction;
     halfword thumb_instruction;
     ARM_OP arm_op;
     THUMB_OP thumb_op;
+    cycles = 1;
     switch (state) {
     case ARM_CODE:
         arm_instruction = mem.get_word(PC);
+        PC += 4;
+        if (!check_condition(static_cast<INSTRUCTION_CONDITION>(arm_instruction >> 28))) break;
         arm_op = decode_arm_instruction(arm_instruction);
-        std::invoke(arm_op, this, arm_instruction);
+        if (arm_op != nullptr) std::invoke(arm_op, this, arm_instruction);
         break;
     case THUMB_CODE:
         thumb_instruction = mem.get_halfword(PC);
+        PC += 2;
         thumb_op = decode_thumb_instruction(thumb_instruction);
-        std::invoke(thumb_op, this, thumb_instruction);
+        if (thumb_op != nullptr) std::invoke(thumb_op, this, thumb_instruction);
         break;
     }
+    return cycles;
+}
+
+// CPSR mode bits of each CPU_OPERATING_MODE, system mode (0x1F) shares the user registers
+static const word mode_bits[6] = {0x10, 0x11, 0x12, 0x13, 0x17, 0x1B};
+
+// Writes the whole CPSR, switching the register bank and the instruction set to match
+void CPU::set_cpsr(word value) {
+    CPSR = value;
+    mode = USR;
+    for (int m = 0; m < 6; m++) {
+        if ((value & 0x1F) == mode_bits[m]) mode = static_cast<CPU_OPERATING_MODE>(m);
+    }
+    state = (value & STATE_BIT) ? THUMB_CODE : ARM_CODE;
+    if (interrupts != nullptr) interrupts->update();
+}
+
+void CPU::set_hle_bios(BIOS* bios) {
+    hle_bios = bios;
+}
+
+void CPU::set_interrupt_controller(InterruptController* controller) {
+    interrupts = controller;
+}
+
+// https://problemkaputt.de/gbatek.htm#armcpuexceptions
+// Taken between two instructions, the handler returns to PC with SUBS PC, LR, #4. Returns the cycles taken.
+// With the HLE BIOS, the BIOS handler is run natively up to the call of the user handler.
+int CPU::interrupt() {
+    cycles = 0;
+    enter_exception(IRQ, BIOS_IRQ_VECTOR, PC + 4);
+    if (hle_bios != nullptr) {
+        word& sp = *reg[IRQ][13];
+        sp -= 24;
+        transfer_registers(sp, 0x500F, false, IRQ);
+        *reg[IRQ][14] = BIOS_IRQ_RETURN;
+        PC            = mem.get_word(IRQ_HANDLER_ADDRESS) & ~3;
+    }
+    return cycles;
+}
+
+// https://problemkaputt.de/gbatek.htm#biosfunctionshalt
+// The CPU stops until an enabled interrupt is requested, regardless of IME and the CPSR. It does not
+// stop at all when one is already pending.
+void CPU::halt() {
+    halted = true;
+    profiler.count(IDLE_HALT);
+    if (interrupts != nullptr) interrupts->update();
+}
+
+void CPU::wake() {
+    halted = false;
+}
+
+// Called whenever something other than the CPU may have changed memory
+void CPU::reset_idle_detection() {
+    idle_loop   = false;
+    idle_branch = 0;
+}
+
+// Loops longer than this are unlikely to be waiting on anything
+static const word IDLE_LOOP_MAX_SIZE = 64;
+
+void CPU::check_idle_loop(word branch) {
+    if (PC > branch || branch - PC > IDLE_LOOP_MAX_SIZE) return;
+    if (branch == idle_branch && CPSR == idle_cpsr && idle_write_count == mem.get_write_count()) {
+        bool same = true;
+        for (int r = 0; r < 16 && same; r++) {
+            same = *reg[mode][r] == idle_regs[r];
+        }
+        if (same) {
+            idle_loop = true;
+            profiler.count(IDLE_LOOP);
+            return;
+        }
+    }
+    idle_branch      = branch;
+    idle_cpsr        = CPSR;
+    idle_write_count = mem.get_write_count();
+    for (int r = 0; r < 16; r++) {
+        idle_regs[r] = *reg[mode][r];
+    }
 }
 
 word* CPU::get_reg(int r) {
@@ -213,6 +349,7 @@ CPU::ARM_OP CPU::decode_arm_instruction(word instruction) {
     if ((instruction & 0x0F000000) == 0x0B000000) return &CPU::arm_branch_link;
     if ((instruction & 0x0F000000) == 0x0A000000) return &CPU::arm_branch;
     if ((instruction & 0x0E100000) == 0x08100000) return &CPU::arm_load_multiple;
+    if ((instruction & 0x0E100000) == 0x08000000) return &CPU::arm_store_multiple;
     // implement undefined instruction trap maybe
     if ((instruction & 0x0C100000) == 0x04100000) return &CPU::arm_load_mem_reg;
     if ((instruction & 0x0C100000) == 0x04000000) return &CPU::arm_store_reg_mem;
@@ -223,10 +360,10 @@ CPU::ARM_OP CPU::decode_arm_instruction(word instruction) {
     // if ((instruction & 0x0FA000F0) == 0x00800090) return MULL; // maybe add MLAL to enum of ARM Instructions
     if ((instruction & 0x0FE000F0) == 0x00200090) return &CPU::arm_multiply_accumulate;
     if ((instruction & 0x0FE000F0) == 0x00000090) return &CPU::arm_multiply;
-    if ((instruction & 0x0A000000) == 0x00000000) return &CPU::arm_data_processing; // data processing
     if ((instruction & 0x0FBF0FFF) == 0x010F0000) return &CPU::arm_mov_psr_reg;
     if ((instruction & 0x0FBFFFF0) == 0x0129F000) return &CPU::arm_mov_reg_psr;
     if ((instruction & 0x0DBFF000) == 0x0128F000) return &CPU::arm_mov_reg_psr;
+    if ((instruction & 0x0C000000) == 0x00000000) return &CPU::arm_data_processing; // data processing
 #ifdef COPROC_SUPPORT
     if ((instruction & 0x0F100010) == 0x0E100010) return ARM_INSTRUCTION::MRC;
     if ((instruction & 0x0F100010) == 0x0E000010) return ARM_INSTRUCTION::MCR;
@@ -239,6 +376,11 @@ CPU::ARM_OP CPU::decode_arm_instruction(word instruction) {
 }
 
 CPU::THUMB_OP CPU::decode_thumb_instruction(word instruction) {
+    if ((instruction & 0xFF00) == 0xDF00) return &CPU::thumb_software_interrupt;
+    if ((instruction & 0xFE00) == 0xB400) return &CPU::thumb_push;
+    if ((instruction & 0xFE00) == 0xBC00) return &CPU::thumb_pop;
+    if ((instruction & 0xF800) == 0xC000) return &CPU::thumb_store_multiple;
+    if ((instruction & 0xF800) == 0xC800) return &CPU::thumb_load_multiple;
     return nullptr;
     /*
     if ((instruction & 0xE000) == 0x0000) {
@@ -320,114 +462,186 @@ bool CPU::check_flag(CPSR_BIT_FLAG flag) {
 }
 
 void CPU::arm_branch_exchange(word instruction) {
-    word* reg = get_reg(instruction & 0xF);
-    PC = *reg;
-    if (*reg & 0x1) {
+    word target = arm_read_register(instruction & 0xF, false);
+    if (target & 0x1) {
         state = THUMB_CODE;
+        CPSR |= STATE_BIT;
+        PC = target & ~1;
+    } else {
+        state = ARM_CODE;
+        CPSR &= ~STATE_BIT;
+        PC = target & ~3;
     }
 }
 
+// The offset is relative to the instruction address + 8, PC already points 4 bytes past the instruction
 void CPU::arm_branch(word instruction) {
-    int offset = (instruction & 0x00FFFFFF) << 2;
-    PC += offset;
+    int offset  = static_cast<int32_t>(instruction << 8) >> 6;
+    word branch = PC - 4;
+    PC += 4 + offset;
+    if (offset < 0) check_idle_loop(branch);
 }
 
 void CPU::arm_branch_link(word instruction) {
-    int offset = (instruction & 0x00FFFFFF) << 2;
+    int offset = static_cast<int32_t>(instruction << 8) >> 6;
     *get_reg(14) = PC;
-    PC += offset;
+    PC += 4 + offset;
 }
 
-void CPU::arm_data_processing(word instruction) {
-    word operand_1, operand_2, result;
-    word* dest_reg = get_reg(instruction >> 12);
-    bool set_overflow_flag, set_carry_flag, set_zero_flag, set_sign_flag;
-    operand_1 = *get_reg(instruction >> 16);
+// r15 reads as the instruction address + 8, or + 12 when the shift amount comes from a register.
+// PC already points 4 bytes past the instruction.
+word CPU::arm_read_register(int r, bool shift_by_register) {
+    if (r == 15) return PC + (shift_by_register ? 8 : 4);
+    return *get_reg(r);
+}
+
+// https://problemkaputt.de/gbatek.htm#armopcodesdataprocessingalu
+// Second operand and shifter carry out, carry keeps the C flag when nothing is shifted out
+word CPU::arm_shifter_operand(word instruction, bool& carry) {
+    carry = check_flag(CARRY_FLAG);
     if (is_bit_set(instruction, 25)) {
-        // Immediate value operand
-        operand_2 = rotate_right(instruction & 0xFF, instruction >> 8 & 0xF);
+        int rotate = (instruction >> 8 & 0xF) * 2;
+        word value = rotate_right(instruction & 0xFF, rotate);
+        if (rotate != 0) carry = value >> 31;
+        return value;
+    }
+    bool shift_by_register = is_bit_set(instruction, 4);
+    word value             = arm_read_register(instruction & 0xF, shift_by_register);
+    int type               = instruction >> 5 & 0x3;
+    int amount;
+    if (shift_by_register) {
+        cycles += 1;
+        amount = *get_reg(instruction >> 8 & 0xF) & 0xFF;
+        if (amount == 0) return value;
     } else {
-        operand_2 = *get_reg(instruction & 0xF);
-        operand_2 <<= ((instruction & 0xFF0) >> 4);
-        // Register Operand
-    }
-    switch (instruction >> 21 & 0xF) {
-        case 0x0:   // AND
-        result = operand_1 & operand_2;
-        *dest_reg = result;
-        break;
-        case 0x1: // EOR
-        result = operand_1 ^ operand_2;
-        *dest_reg = result;
-        break;
-        case 0x2: // SUB
-        result = operand_1 - operand_2;
-        *dest_reg = result;
-        break;
-        case 0x3: // RSB
-        result = operand_2 - operand_1;
-        *dest_reg = result;
-        break;
-        case 0x4: // ADD
-        result = operand_1 + operand_2;
-        *dest_reg = result;
-        break;
-        case 0x5: // ADC
-        result = operand_1 + operand_2 + is_bit_set(CPSR, 29);
-        *dest_reg = result;
-        break;
-        case 0x6: // SBC
-        result = operand_1 - operand_2 + is_bit_set(CPSR, 29) - 1;
-        *dest_reg = result;
-        break;
-        case 0x7: // RSC
-        result = operand_2 - operand_1 + is_bit_set(CPSR, 29) - 1;
-        *dest_reg = result;
-        break;
-        case 0x8: // TST
-        result = operand_1 & operand_2;
-        break;
-        case 0x9: // TEQ
-        result = operand_1 ^ operand_2;
-        break;
-        case 0xA: // CMP
-        result = operand_1 - operand_2;
-        break;
-        case 0xB: // CMN
-        result = operand_1 + operand_2;
-        break;
-        case 0xC: // ORR
-        result = operand_1 | operand_2;
-        *dest_reg = result;
-        break;
-        case 0xD: // MOV
-        result = operand_2;
-        *dest_reg = result;
-        break;
-        case 0xE: // BIC
-        result = operand_1 & (!operand_2);
-        *dest_reg = result;
-        break;
-        case 0xF: // MVN
-        result = !operand_2;
-        *dest_reg = result;
-        break;
+        amount = instruction >> 7 & 0x1F;
+        if (amount == 0) {
+            switch (type) {
+                case 0:  // LSL #0
+                    return value;
+                case 1:  // LSR #32
+                case 2:  // ASR #32
+                    amount = 32;
+                    break;
+                case 3: {  // RRX
+                    word carry_in = carry;
+                    carry         = value & 0x1;
+                    return (value >> 1) | (carry_in << 31);
+                }
+            }
+        }
     }
-    if (is_bit_set(instruction, 20)) {
-        if (dest_reg == &PC) {
-            CPSR = *PSR[mode];
-        } else {
+    switch (type) {
+        case 0:  // LSL
+            if (amount < 32) {
+                carry = value >> (32 - amount) & 0x1;
+                return value << amount;
+            }
+            carry = amount == 32 && (value & 0x1);
+            return 0;
+        case 1:  // LSR
+            if (amount < 32) {
+                carry = value >> (amount - 1) & 0x1;
+                return value >> amount;
+            }
+            carry = amount == 32 && (value >> 31);
+            return 0;
+        case 2:  // ASR
+            if (amount < 32) {
+                carry = value >> (amount - 1) & 0x1;
+                return static_cast<int32_t>(value) >> amount;
+            }
+            carry = value >> 31;
+            return carry ? 0xFFFFFFFF : 0;
+        default:  // ROR, by a multiple of 32 the value is unchanged and C gets bit 31
+            value = rotate_right(value, amount & 0x1F);
+            carry = value >> 31;
+            return value;
+    }
+}
 
-        if (set_overflow_flag) 
-            CPSR |= CPSR_BIT_FLAG::OVERFLOW_FLAG;
-        if (set_carry_flag)
-            CPSR |= CPSR_BIT_FLAG::CARRY_FLAG;
-        if (set_zero_flag)
-            CPSR |= CPSR_BIT_FLAG::ZERO_FLAG;
-        if (set_sign_flag)
-            CPSR |= CPSR_BIT_FLAG::SIGN_FLAG;
-        }
+void CPU::arm_data_processing(word instruction) {
+    int opcode             = instruction >> 21 & 0xF;
+    int rd                 = instruction >> 12 & 0xF;
+    bool shift_by_register = !is_bit_set(instruction, 25) && is_bit_set(instruction, 4);
+    word carry_in          = check_flag(CARRY_FLAG);
+    bool overflow          = check_flag(OVERFLOW_FLAG);
+    bool carry;
+    word operand_2 = arm_shifter_operand(instruction, carry);
+    word operand_1 = arm_read_register(instruction >> 16 & 0xF, shift_by_register);
+    word result;
+    // Logical operations take C from the shifter and leave V, arithmetic ones compute both
+    switch (opcode) {
+        case 0x0:  // AND
+        case 0x8:  // TST
+            result = operand_1 & operand_2;
+            break;
+        case 0x1:  // EOR
+        case 0x9:  // TEQ
+            result = operand_1 ^ operand_2;
+            break;
+        case 0x2:  // SUB
+        case 0xA:  // CMP
+            result   = operand_1 - operand_2;
+            carry    = operand_1 >= operand_2;
+            overflow = ((operand_1 ^ operand_2) & (operand_1 ^ result)) >> 31;
+            break;
+        case 0x3:  // RSB
+            result   = operand_2 - operand_1;
+            carry    = operand_2 >= operand_1;
+            overflow = ((operand_2 ^ operand_1) & (operand_2 ^ result)) >> 31;
+            break;
+        case 0x4:  // ADD
+        case 0xB:  // CMN
+            result   = operand_1 + operand_2;
+            carry    = result < operand_1;
+            overflow = (~(operand_1 ^ operand_2) & (operand_1 ^ result)) >> 31;
+            break;
+        case 0x5:  // ADC
+            result   = operand_1 + operand_2 + carry_in;
+            carry    = (uint64_t(operand_1) + operand_2 + carry_in) >> 32;
+            overflow = (~(operand_1 ^ operand_2) & (operand_1 ^ result)) >> 31;
+            break;
+        case 0x6:  // SBC
+            result   = operand_1 - operand_2 - (1 - carry_in);
+            carry    = uint64_t(operand_1) >= uint64_t(operand_2) + (1 - carry_in);
+            overflow = ((operand_1 ^ operand_2) & (operand_1 ^ result)) >> 31;
+            break;
+        case 0x7:  // RSC
+            result   = operand_2 - operand_1 - (1 - carry_in);
+            carry    = uint64_t(operand_2) >= uint64_t(operand_1) + (1 - carry_in);
+            overflow = ((operand_2 ^ operand_1) & (operand_2 ^ result)) >> 31;
+            break;
+        case 0xC:  // ORR
+            result = operand_1 | operand_2;
+            break;
+        case 0xD:  // MOV
+            result = operand_2;
+            break;
+        case 0xE:  // BIC
+            result = operand_1 & ~operand_2;
+            break;
+        default:  // MVN
+            result = ~operand_2;
+            break;
+    }
+    bool test = opcode >= 0x8 && opcode <= 0xB;  // TST, TEQ, CMP and CMN only set the flags
+    if (!test) *get_reg(rd) = result;
+    if (!is_bit_set(instruction, 20)) {
+        if (!test && rd == 15) PC &= ~3;
+        return;
     }
+    if (!test && rd == 15) {
+        // returns from an exception, SUBS PC, LR, #4 at the end of an IRQ handler
+        set_cpsr(*PSR[mode]);
+        PC &= state == THUMB_CODE ? ~1 : ~3;
+        return;
+    }
+    CPSR &= ~(SIGN_FLAG | ZERO_FLAG | CARRY_FLAG | OVERFLOW_FLAG);
+    if (result & 0x80000000) CPSR |= SIGN_FLAG;
+    if (result == 0) CPSR |= ZERO_FLAG;
+    if (carry) CPSR |= CARRY_FLAG;
+    if (overflow) CPSR |= OVERFLOW_FLAG;
 }
 
 void CPU::arm_mov_psr_reg(word instruction){
@@ -467,14 +681,177 @@ void CPU::arm_load_mem_reg_byte(word instruction){
 
 }
 void CPU::arm_store_multiple(word instruction){
-
+    arm_block_data_transfer(instruction, false);
 }
 void CPU::arm_load_multiple(word instruction){
+    arm_block_data_transfer(instruction, true);
+}
+
+// https://problemkaputt.de/gbatek.htm#armopcodesmemoryblockdatatransferldmstm
+void CPU::arm_block_data_transfer(word instruction, bool load) {
+    halfword list  = instruction & 0xFFFF;
+    int rn         = (instruction >> 16) & 0xF;
+    bool pre       = is_bit_set(instruction, 24);
+    bool up        = is_bit_set(instruction, 23);
+    bool psr       = is_bit_set(instruction, 22);
+    bool writeback = is_bit_set(instruction, 21);
+    word base      = *get_reg(rn);
+    // an empty list transfers r15 and moves the base as if all 16 registers were transferred
+    word size      = list == 0 ? 0x40 : __builtin_popcount(list) * 4;
+    if (list == 0) list = 1 << 15;
+    word start     = up ? base + (pre ? 4 : 0) : base - size + (pre ? 0 : 4);
+    word new_base  = up ? base + size : base - size;
+    // the user bank is transferred with the S bit, unless it is a load of r15
+    bool user_bank = psr && !(load && (list & (1 << 15)));
+    // a stored base is the written back value unless it is the first register, a loaded base wins
+    // over the writeback
+    bool early_writeback = writeback && (load || (list & ((1 << rn) - 1)));
+    if (early_writeback) *get_reg(rn) = new_base;
+    transfer_registers(start, list, load, user_bank ? USR : mode);
+    if (writeback && !early_writeback) *get_reg(rn) = new_base;
+    if (load && (list & (1 << 15))) {
+        if (psr) set_cpsr(*PSR[mode]);
+        PC &= state == THUMB_CODE ? ~1 : ~3;
+    }
+}
 
+// Transfers the registers in list, lowest register at the lowest address. The memory region is resolved
+// once for the whole transfer, and the registers are copied straight to or from its backing array when
+// the range stays in plain memory. Only transfers crossing a region boundary or touching IO go through
+// Memory one register at a time.
+void CPU::transfer_registers(word address, halfword list, bool load, CPU_OPERATING_MODE bank) {
+    address &= ~3;
+    int count   = __builtin_popcount(list);
+    word** regs = reg[bank];
+    cycles += mem.access_cycles(address, 4, false) + (count - 1) * mem.access_cycles(address, 4, true) + load;
+    size_t available;
+    byte* p = mem.get_plain_pointer(address, available, !load);
+    if (p != nullptr && available >= size_t(count) * 4) {
+        word* words = reinterpret_cast<word*>(p);
+        if (load) {
+            for (; list != 0; list &= list - 1) {
+                *regs[__builtin_ctz(list)] = *words++;
+            }
+        } else {
+            // r15 is stored as the instruction address + 12
+            for (; list != 0; list &= list - 1) {
+                int r    = __builtin_ctz(list);
+                *words++ = r == 15 ? PC + 8 : *regs[r];
+            }
+            mem.mark_video_dirty(address, count * 4);
+        }
+        return;
+    }
+    for (; list != 0; list &= list - 1, address += 4) {
+        int r = __builtin_ctz(list);
+        if (load) {
+            *regs[r] = mem.get_word(address);
+        } else {
+            mem.set_word(address, r == 15 ? PC + 8 : *regs[r]);
+        }
+    }
 }
+
+// https://problemkaputt.de/gbatek.htm#thumbopcodesmemorymultipleloadstorepushpopandldmstm
+void CPU::thumb_push(halfword instruction) {
+    halfword list = (instruction & 0xFF) | (is_bit_set(instruction, 8) ? 1 << 14 : 0);
+    word& sp      = *get_reg(13);
+    if (list == 0) return;
+    sp -= __builtin_popcount(list) * 4;
+    transfer_registers(sp, list, false, mode);
+}
+
+void CPU::thumb_pop(halfword instruction) {
+    halfword list = (instruction & 0xFF) | (is_bit_set(instruction, 8) ? 1 << 15 : 0);
+    word& sp      = *get_reg(13);
+    if (list == 0) return;
+    transfer_registers(sp, list, true, mode);
+    sp += __builtin_popcount(list) * 4;
+    // POP {PC} does not switch state on the ARM7
+    if (list & (1 << 15)) PC &= ~1;
+}
+
+void CPU::thumb_store_multiple(halfword instruction) {
+    thumb_block_data_transfer(instruction, false);
+}
+
+void CPU::thumb_load_multiple(halfword instruction) {
+    thumb_block_data_transfer(instruction, true);
+}
+
+// Same base and empty list rules as the ARM increment after transfers, with writeback
+void CPU::thumb_block_data_transfer(halfword instruction, bool load) {
+    halfword list = instruction & 0xFF;
+    int rb        = (instruction >> 8) & 0x7;
+    word& base    = *get_reg(rb);
+    word size     = list == 0 ? 0x40 : __builtin_popcount(list) * 4;
+    word start    = base;
+    if (list == 0) list = 1 << 15;
+    bool early_writeback = load || (list & ((1 << rb) - 1));
+    if (early_writeback) base = start + size;
+    transfer_registers(start, list, load, mode);
+    if (!early_writeback) base = start + size;
+    if (load && (list & (1 << 15))) PC &= ~1;
+}
+
 void CPU::arm_single_data_swap(word instruction){
 
 }
 void CPU::arm_software_interrupt(word instruction){
+    // the BIOS only looks at the upper byte of the comment field
+    software_interrupt((instruction >> 16) & 0xFF);
+}
+
+void CPU::thumb_software_interrupt(halfword instruction) {
+    software_interrupt(instruction & 0xFF);
+}
+
+// https://problemkaputt.de/gbatek.htm#biosfunctions
+void CPU::software_interrupt(int number) {
+    if (hle_bios != nullptr && number == SWI_HALT) {
+        halt();
+        return;
+    }
+    if (hle_bios != nullptr && (number == SWI_INTR_WAIT || number == SWI_VBLANK_INTR_WAIT)) {
+        intr_wait(number == SWI_VBLANK_INTR_WAIT);
+        return;
+    }
+    if (hle_bios != nullptr && hle_bios->handles(number)) {
+        cycles += hle_bios->call(number, r0, r1, r2, r3);
+        return;
+    }
+    if (hle_bios != nullptr) {
+        // only the IRQ vector is mapped in the HLE BIOS ROM, the SWI vector would run into zeros
+        log_warning("Unimplemented HLE SWI " + std::to_string(number));
+        return;
+    }
+    enter_exception(SVC, 0x08, PC);
+}
+
+// https://problemkaputt.de/gbatek.htm#biosinterruptfunctions
+// While no flag is set, the CPU halts on the SWI itself so it runs again once the interrupt has been
+// handled. Those checks are part of the same wait, they must not discard the flags set by the handler.
+void CPU::intr_wait(bool vblank) {
+    if (vblank && !intr_waiting) {
+        r0 = 1;
+        r1 = 1;
+    }
+    cycles += 10;
+    intr_waiting = !hle_bios->intr_wait(r0 != 0 && !intr_waiting, r1);
+    if (intr_waiting) {
+        PC -= state == ARM_CODE ? 4 : 2;
+        halt();
+    } else if (interrupts != nullptr) {
+        interrupts->update();
+    }
+}
 
+// https://problemkaputt.de/gbatek.htm#armcpuexceptions
+void CPU::enter_exception(CPU_OPERATING_MODE exception_mode, word vector, word return_address) {
+    word old_cpsr = CPSR;
+    set_cpsr((CPSR & ~(0x1F | STATE_BIT)) | mode_bits[exception_mode] | IRQ_DISABLE);
+    *reg[mode][14] = return_address;
+    *PSR[mode]     = old_cpsr;
+    PC             = vector;
+    cycles += 2;
 }
\ No newline at end of file
@@ -2,9 +2,13 @@
 #define CPU_H
 
 // https://problemkaputt.de/gbatek.htm#armcpuoverview
+#include "bios.h"
 #include "memory.h"
+#include "savestate.h"
 #include "utils.h"
 
+class InterruptController;
+
 typedef enum {
     ARM_CODE,
     THUMB_CODE
@@ -185,18 +189,18 @@ class CPU {
     word* reg[6][16] = {
         {&r0, &r1, &r2, &r3, &r4, &r5, &r6, &r7, &r8, &r9, &r10, &r11, &r12, &r13, &r14, &r15},                              // usr
         {&r0, &r1, &r2, &r3, &r4, &r5, &r6, &r7, &fiq_r8, &fiq_r9, &fiq_r10, &fiq_r11, &fiq_r12, &fiq_r13, &fiq_r14, &r15},  // fiq
+        {&r0, &r1, &r2, &r3, &r4, &r5, &r6, &r7, &r8, &r9, &r10, &r11, &r12, &irq_r13, &irq_r14, &r15},                      // irq
         {&r0, &r1, &r2, &r3, &r4, &r5, &r6, &r7, &r8, &r9, &r10, &r11, &r12, &svc_r13, &svc_r14, &r15},                      // svc
         {&r0, &r1, &r2, &r3, &r4, &r5, &r6, &r7, &r8, &r9, &r10, &r11, &r12, &abt_r13, &abt_r14, &r15},                      // abt
-        {&r0, &r1, &r2, &r3, &r4, &r5, &r6, &r7, &r8, &r9, &r10, &r11, &r12, &irq_r13, &irq_r14, &r15},                      // irq
         {&r0, &r1, &r2, &r3, &r4, &r5, &r6, &r7, &r8, &r9, &r10, &r11, &r12, &und_r13, &und_r14, &r15}                       // und
-    };
+    };  // rows follow CPU_OPERATING_MODE
 
     word* PSR[6] {
         &CPSR,
         &fiq_SPSR,
+        &irq_SPSR,
         &svc_SPSR,
         &abt_SPSR,
-        &irq_SPSR,
         &und_SPSR
     };
 
@@ -204,12 +208,56 @@ class CPU {
 
     Memory& mem;
 
+    int cycles;  // cycles taken by the instruction being executed
+
+    BIOS* hle_bios;  // services SWIs natively when set, otherwise they jump into the BIOS ROM
+    InterruptController* interrupts;  // told about CPSR changes, which can mask or unmask IRQs
+
+    // Idle loop detection: the state at a short backward branch is compared with the state the last
+    // time it was taken. Same registers and no memory write in between means the loop can only
+    // repeat itself until an event changes the IO registers.
+    bool halted;
+    bool intr_waiting;  // halted in IntrWait, the SWI runs again after each interrupt
+    bool idle_loop;
+    word idle_branch;  // address of the branch of the candidate loop
+    word idle_regs[16];
+    word idle_cpsr;
+    uint64_t idle_write_count;
+
+    void check_idle_loop(word branch);
+    void set_cpsr(word value);
+    word arm_read_register(int r, bool shift_by_register);
+    word arm_shifter_operand(word instruction, bool& carry);
+    void transfer_registers(word address, halfword list, bool load, CPU_OPERATING_MODE bank);
+    void arm_block_data_transfer(word instruction, bool load);
+    void thumb_block_data_transfer(halfword instruction, bool load);
+
+    void enter_exception(CPU_OPERATING_MODE exception_mode, word vector, word return_address);
+    void software_interrupt(int number);
+    void intr_wait(bool vblank);
+
     public:
     typedef void (CPU::* ARM_OP)(word);
     typedef void (CPU::* THUMB_OP)(halfword);
     CPU(Memory& mem);
     ~CPU();
-    void run();
+    int run();
+    void set_hle_bios(BIOS* bios);
+    void set_interrupt_controller(InterruptController* controller);
+    int interrupt();
+    word get_cpsr() {
+        return CPSR;
+    }
+    bool is_idle() {
+        return halted || idle_loop;
+    }
+    bool is_halted() {
+        return halted;
+    }
+    void halt();
+    void wake();
+    void reset_idle_detection();
+    void sync_state(Savestate& state);
     word* get_reg(int r);
     void execute_ARM(word instruction);
     void execute_THUMB(halfword instruction);
@@ -235,6 +283,11 @@ class CPU {
     void arm_load_multiple(word instruction);
     void arm_single_data_swap(word instruction);
     void arm_software_interrupt(word instruction);
+    void thumb_software_interrupt(halfword instruction);
+    void thumb_push(halfword instruction);
+    void thumb_pop(halfword instruction);
+    void thumb_store_multiple(halfword instruction);
+    void thumb_load_multiple(halfword instruction);
     ARM_OP decode_arm_instruction(word instruction);
     THUMB_OP decode_thumb_instruction(word instruction);
 };
@@ -0,0 +1,405 @@
+#include "display.h"
+
+#include <algorithm>
+
+#include "memory.h"
+#include "profiler.h"
+#include "utils.h"
+
+static const halfword TRANSPARENT = 0x8000;
+static const byte BACKDROP_KEY    = 4 << 3;
+static const byte NO_KEY          = 0xFF;
+
+// https://problemkaputt.de/gbatek.htm#lcdobjoamattributes
+static const int obj_sizes[3][4][2] = {
+    {{8, 8}, {16, 16}, {32, 32}, {64, 64}},   // square
+    {{16, 8}, {32, 8}, {32, 16}, {64, 32}},   // horizontal
+    {{8, 16}, {8, 32}, {16, 32}, {32, 64}}};  // vertical
+
+// https://problemkaputt.de/gbatek.htm#lcdiodisplaycontrol
+// Bit 3 (CGB mode) can only be set by the BIOS
+static void dispcnt_written(void* owner, int offset, halfword old_value, halfword) {
+    halfword& dispcnt = static_cast<Memory*>(owner)->io_halfword(offset);
+    dispcnt           = (dispcnt & ~0x8) | (old_value & 0x8);
+}
+
+// https://problemkaputt.de/gbatek.htm#lcdiointerruptsandstatus
+// The VBlank, HBlank and VCount flags are set by the hardware only
+static void dispstat_written(void* owner, int offset, halfword old_value, halfword) {
+    halfword& dispstat = static_cast<Memory*>(owner)->io_halfword(offset);
+    dispstat           = (dispstat & ~0x7) | (old_value & 0x7);
+}
+
+// VCOUNT is read only, the scanline counter is driven by Emulator::hdraw
+static void vcount_written(void* owner, int offset, halfword old_value, halfword) {
+    static_cast<Memory*>(owner)->io_halfword(offset) = old_value;
+}
+
+Display::Display(Memory& mem) {
+    mem.set_io_handler(DISPCNT, dispcnt_written, &mem);
+    mem.set_io_handler(DISPSTAT, dispstat_written, &mem);
+    mem.set_io_handler(VCOUNT, vcount_written, &mem);
+    size_t available;
+    io_ram  = mem.get_pointer(IO_RAM_START, available);
+    pal_ram = mem.get_pointer(PAL_RAM_START, available);
+    vram    = mem.get_pointer(VRAM_START, available);
+    oam     = mem.get_pointer(OAM_START, available);
+    line_semi_transparent = false;
+    std::fill(&framebuffer[0][0], &framebuffer[0][0] + SCREEN_WIDTH * SCREEN_HEIGHT, 0);
+}
+
+// Renders from other copies of the video state instead of the live memory
+void Display::set_sources(const byte* _io_ram, const byte* _pal_ram, const byte* _vram, const byte* _oam) {
+    io_ram  = _io_ram;
+    pal_ram = _pal_ram;
+    vram    = _vram;
+    oam     = _oam;
+}
+
+halfword Display::io_halfword(int offset) {
+    return *reinterpret_cast<const halfword*>(io_ram + offset);
+}
+
+const halfword* Display::get_framebuffer() {
+    return &framebuffer[0][0];
+}
+
+void Display::render_scanline(int line) {
+    halfword dispcnt = io_halfword(DISPCNT);
+    if (dispcnt & 0x80) {
+        // forced blank
+        std::fill(framebuffer[line], framebuffer[line] + SCREEN_WIDTH, 0x7FFF);
+        return;
+    }
+    int mode    = dispcnt & 0x7;
+    byte layers = (dispcnt >> 8) & 0x1F;
+    switch (mode) {
+        case 0:
+            layers &= 0x1F;
+            break;
+        case 1:
+            layers &= 0x13;  // BG2 is affine, not implemented yet
+            break;
+        case 2:
+            layers &= 0x10;  // BG2 and BG3 are affine, not implemented yet
+            break;
+        case 3:
+        case 4:
+        case 5:
+            layers &= 0x14;
+            break;
+        default:
+            layers = 0;
+            break;
+    }
+    for (int bg = 0; bg < 4; bg++) {
+        if (!(layers & (1 << bg))) continue;
+        if (mode >= 3) {
+            render_bg_bitmap(mode, line);
+        } else {
+            render_bg_text(bg, line);
+        }
+    }
+    if (dispcnt & 0x9000) {
+        // OBJs are also needed when only the OBJ window is enabled
+        render_obj(line);
+    }
+    composite(line, layers);
+}
+
+// https://problemkaputt.de/gbatek.htm#lcdvramcharacterdata
+void Display::render_bg_text(int bg, int line) {
+    halfword cnt        = io_halfword(BG0CNT + bg * 2);
+    int hofs            = io_halfword(BG0HOFS + bg * 4) & 0x1FF;
+    int vofs            = io_halfword(BG0VOFS + bg * 4) & 0x1FF;
+    size_t char_base    = ((cnt >> 2) & 0x3) * 0x4000;
+    size_t screen_base  = ((cnt >> 8) & 0x1F) * 0x800;
+    bool color_256      = cnt & 0x80;
+    int width           = (cnt & 0x4000) ? 512 : 256;
+    int height          = (cnt & 0x8000) ? 512 : 256;
+    int y               = (line + vofs) & (height - 1);
+    const halfword* pal = reinterpret_cast<const halfword*>(pal_ram);
+    halfword* output    = bg_line[bg];
+
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+        int sx         = (x + hofs) & (width - 1);
+        int block      = (sx >> 8) + (y >> 8) * (width >> 8);
+        size_t offset  = screen_base + block * 0x800 + (((y & 0xFF) >> 3) * 32 + ((sx & 0xFF) >> 3)) * 2;
+        halfword entry = *reinterpret_cast<const halfword*>(vram + offset);
+        int tx         = (entry & 0x400) ? 7 - (sx & 7) : sx & 7;
+        int ty         = (entry & 0x800) ? 7 - (y & 7) : y & 7;
+        int tile       = entry & 0x3FF;
+        byte index     = 0;
+        if (color_256) {
+            size_t address = char_base + tile * 64 + ty * 8 + tx;
+            if (address < 0x10000) index = vram[address];
+        } else {
+            size_t address = char_base + tile * 32 + ty * 4 + tx / 2;
+            if (address < 0x10000) {
+                index = (tx & 1) ? vram[address] >> 4 : vram[address] & 0xF;
+                if (index) index |= (entry >> 12) << 4;
+            }
+        }
+        output[x] = index ? (pal[index] & 0x7FFF) : TRANSPARENT;
+    }
+}
+
+// https://problemkaputt.de/gbatek.htm#lcdvrambitmapbgmodes
+void Display::render_bg_bitmap(int mode, int line) {
+    size_t page         = (io_halfword(DISPCNT) & 0x10) ? 0xA000 : 0;
+    const halfword* pal = reinterpret_cast<const halfword*>(pal_ram);
+    halfword* output    = bg_line[2];
+    switch (mode) {
+        case 3: {
+            const halfword* row = reinterpret_cast<const halfword*>(vram + line * SCREEN_WIDTH * 2);
+            for (int x = 0; x < SCREEN_WIDTH; x++) {
+                output[x] = row[x] & 0x7FFF;
+            }
+            break;
+        }
+        case 4: {
+            const byte* row = vram + page + line * SCREEN_WIDTH;
+            for (int x = 0; x < SCREEN_WIDTH; x++) {
+                output[x] = row[x] ? (pal[row[x]] & 0x7FFF) : TRANSPARENT;
+            }
+            break;
+        }
+        case 5: {
+            // 160x128 frame, the rest of the screen shows lower layers
+            std::fill(output, output + SCREEN_WIDTH, TRANSPARENT);
+            if (line >= 128) break;
+            const halfword* row = reinterpret_cast<const halfword*>(vram + page + line * 160 * 2);
+            for (int x = 0; x < 160; x++) {
+                output[x] = row[x] & 0x7FFF;
+            }
+            break;
+        }
+    }
+}
+
+// https://problemkaputt.de/gbatek.htm#lcdobjoverview
+void Display::render_obj(int line) {
+    std::fill(obj_line, obj_line + SCREEN_WIDTH, TRANSPARENT);
+    std::fill(obj_key, obj_key + SCREEN_WIDTH, NO_KEY);
+    std::fill(obj_semi_transparent, obj_semi_transparent + SCREEN_WIDTH, 0);
+    std::fill(obj_window, obj_window + SCREEN_WIDTH, 0);
+    line_semi_transparent = false;
+
+    halfword dispcnt     = io_halfword(DISPCNT);
+    bool one_dimensional = dispcnt & 0x40;
+    bool bitmap_mode     = (dispcnt & 0x7) >= 3;
+    const halfword* pal  = reinterpret_cast<const halfword*>(pal_ram + 0x200);
+    const byte* tiles    = vram + 0x10000;
+
+    for (int i = 0; i < 128; i++) {
+        const halfword* attr = reinterpret_cast<const halfword*>(oam + i * 8);
+        halfword attr0       = attr[0];
+        halfword attr1       = attr[1];
+        halfword attr2       = attr[2];
+        if (attr0 & 0x100) continue;  // affine OBJs are not implemented yet
+        if (attr0 & 0x200) continue;  // OBJ disabled
+        int shape    = attr0 >> 14;
+        int obj_mode = (attr0 >> 10) & 0x3;
+        if (shape == 3 || obj_mode == 3) continue;  // prohibited
+        int width  = obj_sizes[shape][attr1 >> 14][0];
+        int height = obj_sizes[shape][attr1 >> 14][1];
+        int row    = (line - (attr0 & 0xFF)) & 0xFF;
+        if (row >= height) continue;
+        int x = attr1 & 0x1FF;
+        if (x >= SCREEN_WIDTH) x -= 512;
+        if (attr1 & 0x2000) row = height - 1 - row;
+        int tile = attr2 & 0x3FF;
+        if (bitmap_mode && tile < 512) continue;  // lower OBJ tiles are used by the bitmap
+        bool color_256 = attr0 & 0x2000;
+        bool hflip     = attr1 & 0x1000;
+        byte key       = ((attr2 >> 10) & 0x3) << 3;
+        byte palette   = (attr2 >> 12) << 4;
+        int row_stride = one_dimensional ? (width / 8) * (color_256 ? 2 : 1) : 32;
+        int tile_base  = tile + (row / 8) * row_stride;
+
+        for (int sx = 0; sx < width; sx++) {
+            int screen_x = x + sx;
+            if (screen_x < 0 || screen_x >= SCREEN_WIDTH) continue;
+            int tx     = hflip ? width - 1 - sx : sx;
+            byte index = 0;
+            if (color_256) {
+                int t = (tile_base + (tx / 8) * 2) & 0x3FF;
+                index = tiles[t * 32 + (row & 7) * 8 + (tx & 7)];
+            } else {
+                int t     = (tile_base + tx / 8) & 0x3FF;
+                byte pair = tiles[t * 32 + (row & 7) * 4 + (tx & 7) / 2];
+                index     = (tx & 1) ? pair >> 4 : pair & 0xF;
+                if (index) index |= palette;
+            }
+            if (index == 0) continue;
+            if (obj_mode == 2) {
+                obj_window[screen_x] = 1;
+            } else if (key < obj_key[screen_x]) {
+                // The key only holds the priority, OBJs are walked in OAM order so the strict comparison keeps
+                // the lowest OAM index on equal priorities
+                obj_line[screen_x]             = pal[index] & 0x7FFF;
+                obj_key[screen_x]              = key;
+                obj_semi_transparent[screen_x] = obj_mode == 1;
+                line_semi_transparent |= obj_mode == 1;
+            }
+        }
+    }
+}
+
+// https://problemkaputt.de/gbatek.htm#lcdiowindowfeature
+// Without any enabled window every layer and effect is visible
+void Display::build_window_mask(int line) {
+    halfword dispcnt = io_halfword(DISPCNT);
+    if (!(dispcnt & 0xE000)) {
+        std::fill(window_mask, window_mask + SCREEN_WIDTH, 0x3F);
+        return;
+    }
+    halfword winin  = io_halfword(WININ);
+    halfword winout = io_halfword(WINOUT);
+    std::fill(window_mask, window_mask + SCREEN_WIDTH, winout & 0x3F);
+    if (dispcnt & 0x8000) {
+        byte obj_inside = (winout >> 8) & 0x3F;
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            window_mask[x] = obj_window[x] ? obj_inside : window_mask[x];
+        }
+    }
+    // WIN0 is applied last as it has priority over WIN1
+    for (int w = 1; w >= 0; w--) {
+        if (!(dispcnt & (0x2000 << w))) continue;
+        halfword h = io_halfword(WIN0H + w * 2);
+        halfword v = io_halfword(WIN0V + w * 2);
+        int x1 = h >> 8, x2 = h & 0xFF;
+        int y1 = v >> 8, y2 = v & 0xFF;
+        bool inside_y = y1 <= y2 ? (line >= y1 && line < y2) : (line >= y1 || line < y2);
+        if (!inside_y) continue;
+        byte inside = (winin >> (w * 8)) & 0x3F;
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            bool inside_x  = x1 <= x2 ? (x >= x1 && x < x2) : (x >= x1 || x < x2);
+            window_mask[x] = inside_x ? inside : window_mask[x];
+        }
+    }
+}
+
+// Inserts a layer in the per pixel top/second layer stacks. Written without branches so the
+// loop is vectorized over the whole line, SECOND is false when no effect needs the second layer
+template <bool SECOND>
+void Display::stack_layer(const halfword* color, const byte* key, byte layer) {
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+        bool visible   = !(color[x] & TRANSPARENT) && ((window_mask[x] >> layer) & 1);
+        byte k         = visible ? key[x] : NO_KEY;
+        bool above_top = k < top_key[x];
+        if (SECOND) {
+            bool above_second = k < second_key[x];
+            second_color[x]   = above_top ? top_color[x] : (above_second ? color[x] : second_color[x]);
+            second_layer[x]   = above_top ? top_layer[x] : (above_second ? layer : second_layer[x]);
+            second_key[x]     = above_top ? top_key[x] : (above_second ? k : second_key[x]);
+        }
+        top_color[x] = above_top ? color[x] : top_color[x];
+        top_layer[x] = above_top ? layer : top_layer[x];
+        top_key[x]   = above_top ? k : top_key[x];
+    }
+}
+
+// https://problemkaputt.de/gbatek.htm#lcdiocolorspecialeffects
+// EFFECT is the BLDCNT color special effect, semi-transparent OBJs are alpha blended in every mode
+template <int EFFECT>
+void Display::blend_line(halfword* output, bool semi_transparent) {
+    halfword bldcnt    = io_halfword(BLDCNT);
+    halfword bldalpha  = io_halfword(BLDALPHA);
+    byte first_target  = bldcnt & 0x3F;
+    byte second_target = (bldcnt >> 8) & 0x3F;
+    halfword eva       = std::min(bldalpha & 0x1F, 16);
+    halfword evb       = std::min((bldalpha >> 8) & 0x1F, 16);
+    halfword evy       = std::min(io_halfword(BLDY) & 0x1F, 16);
+
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+        halfword a    = top_color[x];
+        halfword b    = second_color[x];
+        bool effect   = window_mask[x] & 0x20;
+        bool first    = (first_target >> top_layer[x]) & 1;
+        bool second   = (second_target >> second_layer[x]) & 1;
+        bool semi     = semi_transparent && top_layer[x] == LAYER_OBJ && obj_semi_transparent[x];
+        bool alpha    = effect && second && (semi || (EFFECT == 1 && first));
+        bool bright   = effect && first && (EFFECT == 2 || EFFECT == 3);
+        halfword ra   = a & 0x1F, ga = (a >> 5) & 0x1F, ba = (a >> 10) & 0x1F;
+        halfword rb   = b & 0x1F, gb = (b >> 5) & 0x1F, bb = (b >> 10) & 0x1F;
+        halfword r    = std::min((ra * eva + rb * evb) >> 4, 31);
+        halfword g    = std::min((ga * eva + gb * evb) >> 4, 31);
+        halfword bl   = std::min((ba * eva + bb * evb) >> 4, 31);
+        halfword mix  = r | g << 5 | bl << 10;
+        halfword fade = a;
+        if (EFFECT == 2) {
+            fade = (ra + (((31 - ra) * evy) >> 4)) | (ga + (((31 - ga) * evy) >> 4)) << 5 | (ba + (((31 - ba) * evy) >> 4)) << 10;
+        } else if (EFFECT == 3) {
+            fade = (ra - ((ra * evy) >> 4)) | (ga - ((ga * evy) >> 4)) << 5 | (ba - ((ba * evy) >> 4)) << 10;
+        }
+        output[x] = alpha ? mix : (bright ? fade : a);
+    }
+}
+
+void Display::composite(int line, byte layers) {
+    halfword dispcnt = io_halfword(DISPCNT);
+    int effect       = (io_halfword(BLDCNT) >> 6) & 0x3;
+    bool semi        = (layers & 0x10) && line_semi_transparent;
+    bool windowed    = dispcnt & 0xE000;
+    bool blending    = effect != 0 || semi;
+    PROFILER_SECTION section;
+    if (semi || effect == 1) {
+        section = COMPOSITE_ALPHA;
+    } else if (effect != 0) {
+        section = COMPOSITE_BRIGHTNESS;
+    } else if (windowed) {
+        section = COMPOSITE_WINDOW;
+    } else {
+        section = COMPOSITE_COPY;
+    }
+    ScopedTimer timer(section);
+
+    build_window_mask(line);
+    halfword backdrop = *reinterpret_cast<const halfword*>(pal_ram) & 0x7FFF;
+    std::fill(top_color, top_color + SCREEN_WIDTH, backdrop);
+    std::fill(top_layer, top_layer + SCREEN_WIDTH, LAYER_BD);
+    std::fill(top_key, top_key + SCREEN_WIDTH, BACKDROP_KEY);
+    if (blending) {
+        std::fill(second_color, second_color + SCREEN_WIDTH, backdrop);
+        std::fill(second_layer, second_layer + SCREEN_WIDTH, LAYER_NONE);
+        std::fill(second_key, second_key + SCREEN_WIDTH, NO_KEY);
+    }
+
+    for (int bg = 0; bg < 4; bg++) {
+        if (!(layers & (1 << bg))) continue;
+        // OBJs are drawn over BGs of the same priority, then lower BG numbers win
+        std::fill(bg_key, bg_key + SCREEN_WIDTH, ((io_halfword(BG0CNT + bg * 2) & 0x3) << 3) | (bg + 1));
+        if (blending) {
+            stack_layer<true>(bg_line[bg], bg_key, bg);
+        } else {
+            stack_layer<false>(bg_line[bg], bg_key, bg);
+        }
+    }
+    if (layers & 0x10) {
+        if (blending) {
+            stack_layer<true>(obj_line, obj_key, LAYER_OBJ);
+        } else {
+            stack_layer<false>(obj_line, obj_key, LAYER_OBJ);
+        }
+    }
+
+    halfword* output = framebuffer[line];
+    switch (blending ? effect : -1) {
+        case -1:
+            std::copy(top_color, top_color + SCREEN_WIDTH, output);
+            break;
+        case 0:
+            blend_line<0>(output, semi);
+            break;
+        case 1:
+            blend_line<1>(output, semi);
+            break;
+        case 2:
+            blend_line<2>(output, semi);
+            break;
+        case 3:
+            blend_line<3>(output, semi);
+            break;
+    }
+}
@@ -1,6 +1,89 @@
 #ifndef DISPLAY_H
 #define DISPLAY_H
 
-class Display {};
+// https://problemkaputt.de/gbatek.htm#lcdiodisplaycontrol
+#include "memory.h"
+#include "utils.h"
 
-#endif
\ No newline at end of file
+static const int SCREEN_WIDTH  = 240;
+static const int SCREEN_HEIGHT = 160;
+
+// https://problemkaputt.de/gbatek.htm#lcddimensionsandtimings
+static const int HDRAW_CYCLES  = 960;
+static const int HBLANK_CYCLES = 272;
+static const int SCANLINES     = 228;
+
+// IO register offsets, relative to IO_RAM_START
+static const int DISPCNT  = 0x00;
+static const int DISPSTAT = 0x04;
+static const int VCOUNT   = 0x06;
+static const int BG0CNT   = 0x08;
+static const int BG0HOFS  = 0x10;
+static const int BG0VOFS  = 0x12;
+static const int WIN0H    = 0x40;
+static const int WIN1H    = 0x42;
+static const int WIN0V    = 0x44;
+static const int WIN1V    = 0x46;
+static const int WININ    = 0x48;
+static const int WINOUT   = 0x4A;
+static const int BLDCNT   = 0x50;
+static const int BLDALPHA = 0x52;
+static const int BLDY     = 0x54;
+
+// Layer indices, in BLDCNT/WININ bit order
+typedef enum {
+    LAYER_BG0,
+    LAYER_BG1,
+    LAYER_BG2,
+    LAYER_BG3,
+    LAYER_OBJ,
+    LAYER_BD,
+    LAYER_NONE
+} LAYER;
+
+class Display {
+    private:
+    const byte* io_ram;
+    const byte* pal_ram;
+    const byte* vram;
+    const byte* oam;
+
+    halfword framebuffer[SCREEN_HEIGHT][SCREEN_WIDTH];
+
+    // Per scanline layer buffers, colors are BGR555 with TRANSPARENT (bit 15) set for empty pixels
+    halfword bg_line[4][SCREEN_WIDTH];
+    halfword obj_line[SCREEN_WIDTH];
+    byte obj_key[SCREEN_WIDTH];
+    byte bg_key[SCREEN_WIDTH];
+    byte obj_semi_transparent[SCREEN_WIDTH];
+    byte obj_window[SCREEN_WIDTH];
+    byte window_mask[SCREEN_WIDTH];
+    bool line_semi_transparent;
+
+    // Top two visible layers of each pixel, as selected by the compositor. Keys order layers by priority, OBJ before BG0-BG3
+    halfword top_color[SCREEN_WIDTH];
+    halfword second_color[SCREEN_WIDTH];
+    byte top_layer[SCREEN_WIDTH];
+    byte second_layer[SCREEN_WIDTH];
+    byte top_key[SCREEN_WIDTH];
+    byte second_key[SCREEN_WIDTH];
+
+    halfword io_halfword(int offset);
+    void render_bg_text(int bg, int line);
+    void render_bg_bitmap(int mode, int line);
+    void render_obj(int line);
+    void build_window_mask(int line);
+    template <bool SECOND>
+    void stack_layer(const halfword* color, const byte* key, byte layer);
+    template <int EFFECT>
+    void blend_line(halfword* output, bool semi_transparent);
+    void composite(int line, byte layers);
+
+    public:
+    Display(Memory& mem);
+    void set_sources(const byte* io_ram, const byte* pal_ram, const byte* vram, const byte* oam);
+    void render_scanline(int line);
+    const halfword* get_framebuffer();
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "dma.h"
+
+#include <cstring>
+
+#include "soundsystem.h"
+
+static const word source_mask[4] = {0x07FFFFFF, 0x0FFFFFFF, 0x0FFFFFFF, 0x0FFFFFFF};
+static const word dest_mask[4]   = {0x07FFFFFF, 0x07FFFFFF, 0x07FFFFFF, 0x0FFFFFFF};
+static const word count_mask[4]  = {0x3FFF, 0x3FFF, 0x3FFF, 0xFFFF};
+
+DMA::DMA(Memory& _mem, Scheduler& _scheduler, InterruptController& _interrupts)
+    : mem(_mem), scheduler(_scheduler), interrupts(_interrupts) {
+    for (int i = 0; i < 4; i++) {
+        channels[i] = DMAChannel();
+        mem.set_io_handler(DMA0CNT_H + i * DMA_CHANNEL_STRIDE, control_io_written, this);
+    }
+}
+
+void DMA::control_io_written(void* owner, int offset, halfword old_value, halfword) {
+    static_cast<DMA*>(owner)->control_written((offset - DMA0CNT_H) / DMA_CHANNEL_STRIDE, old_value);
+}
+
+// Called after every write to DMAxCNT_H. The channel latches its addresses and count when it gets enabled
+void DMA::control_written(int channel, halfword old_value) {
+    int base       = channel * DMA_CHANNEL_STRIDE;
+    halfword cnt   = mem.io_halfword(DMA0CNT_H + base);
+    DMAChannel& ch = channels[channel];
+    if (!(cnt & 0x8000)) {
+        ch.active = false;
+        return;
+    }
+    if (old_value & 0x8000) return;
+    ch.active = true;
+    ch.source = mem.io_word(DMA0SAD + base) & source_mask[channel];
+    ch.dest   = mem.io_word(DMA0DAD + base) & dest_mask[channel];
+    ch.count  = mem.io_halfword(DMA0CNT_L + base) & count_mask[channel];
+    if (((cnt >> 12) & 0x3) == DMA_IMMEDIATE) transfer(channel);
+}
+
+// Starts the enabled channels waiting for timing, in priority order
+void DMA::trigger(DMA_TIMING timing) {
+    for (int channel = 0; channel < 4; channel++) {
+        if (!channels[channel].active) continue;
+        halfword cnt = mem.io_halfword(DMA0CNT_H + channel * DMA_CHANNEL_STRIDE);
+        if (((cnt >> 12) & 0x3) == timing) transfer(channel);
+    }
+}
+
+// Refills FIFO A (0) or B (1), requested by the sound system when the FIFO runs low
+void DMA::trigger_fifo(int fifo) {
+    word fifo_address = IO_RAM_START + (fifo == 0 ? FIFO_A : FIFO_B);
+    for (int channel = 1; channel <= 2; channel++) {
+        if (!channels[channel].active) continue;
+        halfword cnt = mem.io_halfword(DMA0CNT_H + channel * DMA_CHANNEL_STRIDE);
+        if (((cnt >> 12) & 0x3) == DMA_SPECIAL && channels[channel].dest == fifo_address) transfer(channel);
+    }
+}
+
+// Copies between two plain memory regions in one go. Returns false when either range is not backed
+// by a single array without side effects, or when the destination starts inside the source: the
+// hardware copies forward one unit at a time and reads back the units it has already written there.
+// The caller then falls back to unit transfers.
+bool DMA::bulk_copy(word source, word dest, word bytes) {
+    size_t source_available, dest_available;
+    byte* src = mem.get_plain_pointer(source, source_available, false);
+    byte* dst = mem.get_plain_pointer(dest, dest_available, true);
+    if (src == nullptr || dst == nullptr || source_available < bytes || dest_available < bytes) return false;
+    if (dst > src && dst < src + bytes) return false;
+    std::memmove(dst, src, bytes);
+    mem.mark_video_dirty(dest, bytes);
+    return true;
+}
+
+void DMA::transfer(int channel) {
+    int base       = channel * DMA_CHANNEL_STRIDE;
+    halfword cnt   = mem.io_halfword(DMA0CNT_H + base);
+    DMAChannel& ch = channels[channel];
+    int timing     = (cnt >> 12) & 0x3;
+    int dest_ctrl  = (cnt >> 5) & 0x3;
+    int src_ctrl   = (cnt >> 7) & 0x3;
+    bool fifo      = timing == DMA_SPECIAL && (channel == 1 || channel == 2);
+    int unit       = (fifo || (cnt & 0x400)) ? 4 : 2;
+    word count     = fifo ? 4 : (ch.count == 0 ? count_mask[channel] + 1 : ch.count);
+    int src_step   = src_ctrl == 0 ? unit : (src_ctrl == 1 ? -unit : 0);
+    int dest_step  = (fifo || dest_ctrl == 2) ? 0 : (dest_ctrl == 1 ? -unit : unit);
+    word source    = ch.source & ~(unit - 1);
+    word dest      = ch.dest & ~(unit - 1);
+
+    if (src_step != unit || dest_step != unit || !bulk_copy(source, dest, count * unit)) {
+        for (word i = 0; i < count; i++) {
+            if (unit == 4) {
+                mem.set_word(dest, mem.get_word(source));
+            } else {
+                mem.set_halfword(dest, mem.get_halfword(source));
+            }
+            source += src_step;
+            dest += dest_step;
+        }
+    } else {
+        source += count * unit;
+        dest += count * unit;
+    }
+
+    // 2N + 2(n-1)S + xI, the CPU is stalled for the whole transfer
+    uint64_t cycles = 2 + mem.access_cycles(ch.source, unit, false) + mem.access_cycles(ch.dest, unit, false);
+    cycles += uint64_t(count - 1) * (mem.access_cycles(ch.source, unit, true) + mem.access_cycles(ch.dest, unit, true));
+    scheduler.advance(cycles);
+
+    ch.source = source;
+    ch.dest   = dest;
+    if (cnt & 0x4000) {
+        interrupts.request(static_cast<INTERRUPT>(IRQ_DMA0 + channel));
+    }
+    if ((cnt & 0x200) && timing != DMA_IMMEDIATE) {
+        ch.count = mem.io_halfword(DMA0CNT_L + base) & count_mask[channel];
+        if (dest_ctrl == 3) ch.dest = mem.io_word(DMA0DAD + base) & dest_mask[channel];
+    } else {
+        ch.active = false;
+        mem.io_halfword(DMA0CNT_H + base) &= ~0x8000;
+    }
+}
+
+void DMA::sync_state(Savestate& state) {
+    for (DMAChannel& channel : channels) {
+        state.sync(channel.active);
+        state.sync(channel.source);
+        state.sync(channel.dest);
+        state.sync(channel.count);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef DMA_H
+#define DMA_H
+
+// https://problemkaputt.de/gbatek.htm#gbadmatransfers
+#include "interrupts.h"
+#include "memory.h"
+#include "savestate.h"
+#include "scheduler.h"
+#include "utils.h"
+
+// IO register offsets of channel 0, relative to IO_RAM_START. Channels are DMA_CHANNEL_STRIDE apart
+static const int DMA0SAD            = 0xB0;
+static const int DMA0DAD            = 0xB4;
+static const int DMA0CNT_L          = 0xB8;
+static const int DMA0CNT_H          = 0xBA;
+static const int DMA_CHANNEL_STRIDE = 0xC;
+
+typedef enum {
+    DMA_IMMEDIATE,
+    DMA_VBLANK,
+    DMA_HBLANK,
+    DMA_SPECIAL  // sound FIFO for channels 1 and 2
+} DMA_TIMING;
+
+// Internal registers, latched from IO when the channel is enabled
+struct DMAChannel {
+    bool active;
+    word source;
+    word dest;
+    word count;
+};
+
+class DMA {
+    private:
+    Memory& mem;
+    Scheduler& scheduler;
+    InterruptController& interrupts;
+    DMAChannel channels[4];
+
+    static void control_io_written(void* owner, int offset, halfword old_value, halfword mask);
+    void transfer(int channel);
+    bool bulk_copy(word source, word dest, word bytes);
+
+    public:
+    DMA(Memory& mem, Scheduler& scheduler, InterruptController& interrupts);
+    void control_written(int channel, halfword old_value);
+    void trigger(DMA_TIMING timing);
+    void trigger_fifo(int fifo);
+    void sync_state(Savestate& state);
+};
+
+#endif
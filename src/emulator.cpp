@@ -1,17 +1,107 @@
 #include "emulator.h"
 
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <thread>
 
+#include "profiler.h"
 #include "utils.h"
 
-Emulator::Emulator(std::string filename)
-    : mem(), cpu(mem) {
+Emulator::Emulator(std::string filename, EmulatorOptions _options)
+    : options(_options), mem(), cpu(mem), bios(mem), display(mem), interrupts(mem, cpu, scheduler), serial(mem, scheduler, interrupts), sound(mem, scheduler), dma(mem, scheduler, interrupts), timers(mem, scheduler, sound, dma, interrupts), keys(0x3FF), input_frame(NO_FRAME), replay_ended(false), fast_forward(false), frame(0), start_frame(0), frames_rendered(0), render_frame(true), frames_skipped(0) {
     if (!mem.load_game(filename)) {
         log_error("Unable to load game");
     } else {
         log_success("Game successfully loaded");
     }
+    open_backup(filename);
+    bool hle_bios = true;
+    if (!options.bios_file.empty()) {
+        if (mem.load_bios(options.bios_file)) {
+            log_success("BIOS successfully loaded");
+            hle_bios = false;
+        } else {
+            log_warning("Unable to load " + options.bios_file + ", using the HLE BIOS");
+        }
+    }
+    if (hle_bios) cpu.set_hle_bios(&bios);
+    if (options.threaded_ppu) {
+        render_thread = std::make_unique<RenderThread>(mem);
+    }
+    mem.io_halfword(DISPCNT)  = 0x80;
+    mem.io_halfword(DISPSTAT) = 0;
+    mem.io_halfword(VCOUNT)   = 0;
+    mem.io_halfword(KEYINPUT) = 0x3FF;  // all keys released
+    mem.set_io_handler(KEYINPUT, keypad_io_written, this);
+    mem.set_io_handler(KEYCNT, keypad_io_written, this);
+    if (!options.wav_file.empty()) {
+        wav_sink = std::make_unique<WavSink>(sound.get_output());
+        if (!wav_sink->open(options.wav_file)) {
+            log_warning("Unable to open " + options.wav_file);
+            wav_sink.reset();
+        }
+    }
+    if (!options.video_file.empty()) {
+        frame_sink = std::make_unique<FrameSink>(options.video_format, options.video_changed_only);
+        if (!frame_sink->open(options.video_file)) {
+            log_warning("Unable to open " + options.video_file);
+            frame_sink.reset();
+        } else if (render_thread) {
+            render_thread->set_frame_sink(frame_sink.get());
+        }
+    }
+    scheduler.schedule(EVENT_HBLANK, HDRAW_CYCLES);
+    scheduler.schedule(EVENT_AUDIO, AUDIO_TICK_CYCLES);
+    scheduler.schedule(EVENT_BACKUP_FLUSH, BACKUP_FLUSH_CYCLES);
+    open_movie(hle_bios);
+}
+
+// The save file sits next to the ROM, with a .sav extension
+void Emulator::open_backup(std::string filename) {
+    size_t available;
+    BACKUP_TYPE type = Backup::detect(mem.get_pointer(PAK_ROM_WAIT_STATE_0_START, available), mem.get_rom_size());
+    if (type == BACKUP_NONE) return;
+    size_t dot         = filename.find_last_of('.');
+    size_t slash       = filename.find_last_of('/');
+    bool has_extension = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+    std::string save   = (has_extension ? filename.substr(0, dot) : filename) + ".sav";
+    if (!options.replay_file.empty() || !options.persistent_save) {
+        // the save contents of a replay come from the movie keyframes, it must not touch the save file
+        backup.open("", type, mem.get_rom_size() > 0x1000000);
+        mem.set_backup(&backup);
+        return;
+    }
+    if (backup.open(save, type, mem.get_rom_size() > 0x1000000)) {
+        mem.set_backup(&backup);
+        log_success("Save file " + save + " opened");
+    } else {
+        log_warning("Unable to open " + save + ", saving is disabled");
+    }
+}
+
+// The first keyframe is taken by latch_input() at the start of frame 0, a replay starts from it
+void Emulator::open_movie(bool hle_bios) {
+    size_t available;
+    MovieHeader header;
+    header.version           = EMULATOR_VERSION;
+    header.rom_hash          = hash_bytes(mem.get_pointer(PAK_ROM_WAIT_STATE_0_START, available), mem.get_rom_size());
+    header.flags             = hle_bios ? MOVIE_HLE_BIOS : 0;
+    header.keyframe_interval = options.keyframe_interval;
+    if (!options.record_file.empty()) {
+        if (movie.record(options.record_file, header)) {
+            log_success("Recording to " + options.record_file);
+        } else {
+            log_warning("Unable to open " + options.record_file + " for recording");
+        }
+    } else if (!options.replay_file.empty()) {
+        if (movie.replay(options.replay_file, header)) {
+            log_success("Replaying " + options.replay_file + ", " + std::to_string(movie.length()) + " frames");
+        } else {
+            log_error("Unable to replay " + options.replay_file);
+            replay_ended = true;
+        }
+    }
 }
 
 void Emulator::mem_dump() {
@@ -25,6 +115,290 @@ void Emulator::mem_dump() {
     dump.close();
 }
 
+// Every member that affects the emulation, in a fixed order. Output only state (framebuffers, sound
+// output, frame pacing) is left out.
+void Emulator::sync_state(Savestate& state) {
+    mem.sync_state(state);
+    backup.sync_state(state);
+    cpu.sync_state(state);
+    scheduler.sync_state(state);
+    interrupts.sync_state(state);
+    serial.sync_state(state);
+    sound.sync_state(state);
+    dma.sync_state(state);
+    timers.sync_state(state);
+    state.sync(frame);
+}
+
+uint64_t Emulator::state_hash() {
+    Savestate state;
+    sync_state(state);
+    return hash_bytes(state.get_data().data(), state.get_data().size());
+}
+
+// Connects the serial port to a link cable shared with emulators running on other threads
+void Emulator::connect_link(LinkCable* cable, int id) {
+    serial.connect(cable, id);
+}
+
+// Frontends call this whenever the host keys change, bits are set for released keys like KEYINPUT
+void Emulator::set_keys(halfword _keys) {
+    keys = _keys & 0x3FF;
+}
+
+// Keys are latched once per frame, from the host or the movie being replayed, and a recording takes
+// its keyframes at the same point. A replay thus sees every key change at the cycle it was recorded.
+void Emulator::latch_input() {
+    input_frame = frame;
+    if (movie.get_mode() == MOVIE_REPLAY) {
+        if (frame >= movie.length()) {
+            replay_ended = true;
+            return;
+        }
+        keys = movie.get_keys(frame);
+    }
+    if (movie.needs_keyframe(frame)) {
+        Savestate state;
+        sync_state(state);
+        movie.add_keyframe(state.get_data());
+    }
+    halfword& keyinput = mem.io_halfword(KEYINPUT);
+    if (keyinput != keys) {
+        keyinput = keys;
+        check_keypad();
+    }
+    if (movie.get_mode() == MOVIE_RECORD) movie.add_frame(keys);
+}
+
+// Loads the last keyframe at or before target and replays the frames in between, at most one keyframe
+// interval, without rendering them
+bool Emulator::seek(uint64_t target) {
+    std::vector<byte> data;
+    if (!movie.load_keyframe(target, data)) {
+        log_error("Unable to read the movie keyframes");
+        return false;
+    }
+    Savestate state(std::move(data));
+    sync_state(state);
+    if (!state.good()) {
+        log_error("Corrupt movie keyframe");
+        return false;
+    }
+    // the frame in progress at the keyframe is not rendered either, the render thread and the video
+    // output only start after the seek
+    input_frame  = NO_FRAME;
+    fast_forward = true;
+    render_frame = false;
+    while (frame < target && !replay_ended) {
+        step();
+    }
+    fast_forward   = false;
+    render_frame   = true;
+    frames_skipped = 0;
+    return true;
+}
+
+// Runs the CPU up to the next event, then handles the events that are due
+void Emulator::step() {
+    if (frame != input_frame) latch_input();
+    if (replay_ended) return;
+    // the CPU runs in batches up to the next event, events are only handled between batches
+    // an interrupt becoming pending schedules EVENT_IRQ at the current cycle, which ends the batch
+    while (scheduler.now() < scheduler.next_event()) {
+        if (cpu.is_idle()) {
+            // nothing can change before the next event
+            uint64_t skipped = scheduler.next_event() - scheduler.now();
+            profiler.count(IDLE_SKIPPED, skipped);
+            scheduler.advance(skipped);
+            break;
+        }
+        scheduler.advance(cpu.run());
+    }
+    EVENT event;
+    uint64_t time;
+    while (scheduler.pop(event, time)) {
+        handle_event(event, time);
+    }
+    cpu.reset_idle_detection();
+}
+
 void Emulator::run() {
-    cpu.run();
-}
\ No newline at end of file
+    start_time = std::chrono::steady_clock::now();
+    end_time   = start_time;
+    if (movie.get_mode() == MOVIE_REPLAY && !seek(options.seek_frame)) return;
+    start_frame     = frame;
+    frames_rendered = 0;
+    start_time      = std::chrono::steady_clock::now();
+    if (frame_sink) frame_sink->start();
+    if (render_thread) render_thread->start();
+    if (wav_sink) {
+        // the WAV file is the only audio output and has no real-time deadline, the emulation waits for
+        // its writer rather than dropping audio. The frames replayed by a seek are not written.
+        sound.set_output_enabled(true, true);
+        wav_sink->start();
+    }
+    while ((options.frames == 0 || frame < options.frames) && !replay_ended) {
+        step();
+    }
+    if (render_thread) render_thread->stop();
+    if (frame_sink) frame_sink->stop();
+    if (wav_sink) {
+        sound.set_output_enabled(false, false);
+        wav_sink->stop();
+    }
+    serial.disconnect();
+    if (!backup.flush(true)) log_warning("Unable to write the save file");
+    if (movie.get_mode() != MOVIE_NONE) {
+        std::cout << "state hash at frame " << frame << ": " << std::hex << state_hash() << std::dec << "\n";
+        movie.close();
+    }
+    end_time = std::chrono::steady_clock::now();
+}
+
+void Emulator::report() {
+    uint64_t frames                       = frame - start_frame;
+    std::chrono::duration<double> elapsed = end_time - start_time;
+    std::cout << frames << " frames (" << frames_rendered << " rendered) in " << elapsed.count() << " s, "
+              << frames / elapsed.count() << " fps, frameskip ";
+    if (options.frameskip == FRAMESKIP_AUTO) {
+        std::cout << "auto";
+    } else {
+        std::cout << options.frameskip;
+    }
+    std::cout << (options.headless ? ", headless" : "") << (render_thread ? ", threaded PPU" : "") << "\n";
+    double emulated_seconds = double(scheduler.now()) / CPU_FREQUENCY;
+    if (emulated_seconds > 0) {
+        std::cout << "audio: " << profiler.get_total_ns(AUDIO_MIX) / 1e6 / emulated_seconds << " ms per emulated second\n";
+    }
+    if (frame_sink && frames_rendered > 0) {
+        std::cout << "video: " << frame_sink->get_frames_written() << " frames written, " << frame_sink->get_frames_unchanged()
+                  << " unchanged, " << profiler.get_total_ns(FRAME_OUTPUT) / 1e3 / frames_rendered << " us per frame handed over\n";
+    }
+    profiler.report();
+}
+
+// KEYINPUT is read-only. The keypad interrupt is requested when any (or all, with bit 15) of the keys
+// selected in KEYCNT are pressed
+void Emulator::keypad_io_written(void* owner, int offset, halfword old_value, halfword) {
+    Emulator* emu = static_cast<Emulator*>(owner);
+    if (offset == KEYINPUT) {
+        emu->mem.io_halfword(KEYINPUT) = old_value;
+        return;
+    }
+    emu->check_keypad();
+}
+
+void Emulator::check_keypad() {
+    halfword cnt     = mem.io_halfword(KEYCNT);
+    halfword pressed = ~mem.io_halfword(KEYINPUT) & cnt & 0x3FF;
+    bool all         = cnt & 0x8000;
+    if ((cnt & 0x4000) && (all ? pressed == (cnt & 0x3FF) : pressed != 0)) {
+        interrupts.request(IRQ_KEYPAD);
+    }
+}
+
+void Emulator::handle_event(EVENT event, uint64_t time) {
+    switch (event) {
+        case EVENT_HBLANK:
+            hblank(time);
+            break;
+        case EVENT_HDRAW:
+            hdraw(time);
+            break;
+        case EVENT_AUDIO:
+            sound.tick(time);
+            scheduler.schedule_at(EVENT_AUDIO, time + AUDIO_TICK_CYCLES);
+            break;
+        case EVENT_TIMER0:
+        case EVENT_TIMER1:
+        case EVENT_TIMER2:
+        case EVENT_TIMER3:
+            timers.overflow(event - EVENT_TIMER0, time);
+            break;
+        case EVENT_BACKUP_FLUSH:
+            backup.flush(false);
+            scheduler.schedule_at(EVENT_BACKUP_FLUSH, time + BACKUP_FLUSH_CYCLES);
+            break;
+        case EVENT_LINK_SYNC:
+            serial.sync(time);
+            break;
+        case EVENT_SERIAL:
+            serial.update(time);
+            break;
+        case EVENT_IRQ:
+            interrupts.service();
+            break;
+        default:
+            log_error("Unhandled scheduler event");
+            break;
+    }
+}
+
+// https://problemkaputt.de/gbatek.htm#lcdiointerruptsandstatus
+void Emulator::hblank(uint64_t time) {
+    halfword& dispstat = mem.io_halfword(DISPSTAT);
+    int line           = mem.io_halfword(VCOUNT);
+    dispstat |= 0x2;
+    if (dispstat & 0x10) interrupts.request(IRQ_HBLANK);
+    if (line < SCREEN_HEIGHT) {
+        if (render_frame && render_thread) {
+            render_thread->submit_scanline(line, frame);
+        } else if (render_frame) {
+            display.render_scanline(line);
+        }
+        dma.trigger(DMA_HBLANK);
+    }
+    scheduler.schedule_at(EVENT_HDRAW, time + HBLANK_CYCLES);
+}
+
+void Emulator::hdraw(uint64_t time) {
+    halfword& dispstat = mem.io_halfword(DISPSTAT);
+    int line           = (mem.io_halfword(VCOUNT) + 1) % SCANLINES;
+    mem.io_halfword(VCOUNT) = line;
+    dispstat &= ~0x2;
+    if (line == SCREEN_HEIGHT) {
+        dispstat |= 0x1;
+        if (dispstat & 0x8) interrupts.request(IRQ_VBLANK);
+        dma.trigger(DMA_VBLANK);
+        end_frame();
+    } else if (line == SCANLINES - 1) {
+        // the VBlank flag is already cleared during the last scanline
+        dispstat &= ~0x1;
+    }
+    if ((dispstat >> 8) == line) {
+        dispstat |= 0x4;
+        if (dispstat & 0x20) interrupts.request(IRQ_VCOUNT);
+    } else {
+        dispstat &= ~0x4;
+    }
+    scheduler.schedule_at(EVENT_HBLANK, time + HDRAW_CYCLES);
+}
+
+std::chrono::steady_clock::time_point Emulator::frame_deadline(uint64_t n) {
+    std::chrono::duration<double> frame_time(double(SCANLINES * (HDRAW_CYCLES + HBLANK_CYCLES)) / CPU_FREQUENCY / options.speed);
+    return start_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(frame_time * double(n - start_frame));
+}
+
+// Called at the start of VBlank. Skipped frames still run the CPU and every timing event, only
+// scanline rendering is left out. Rendered frames go to the video output, from the render thread when
+// there is one. Frames are paced to the target speed unless headless.
+void Emulator::end_frame() {
+    if (render_frame) frames_rendered++;
+    if (render_frame && frame_sink && !render_thread) frame_sink->submit(display.get_framebuffer(), frame);
+    frame++;
+    if (fast_forward) {
+        render_frame = false;
+        return;
+    }
+    if (options.frameskip == FRAMESKIP_AUTO) {
+        // skip when more than a frame behind the target speed
+        bool behind  = std::chrono::steady_clock::now() > frame_deadline(frame + 1);
+        render_frame = !behind || frames_skipped >= MAX_AUTO_FRAMESKIP;
+    } else {
+        render_frame = frame % (options.frameskip + 1) == 0;
+    }
+    frames_skipped = render_frame ? 0 : frames_skipped + 1;
+    if (!options.headless) {
+        std::this_thread::sleep_until(frame_deadline(frame));
+    }
+}
@@ -1,22 +1,119 @@
 #ifndef EMULATOR_H
 #define EMULATOR_H
 
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <string>
 
+#include "backup.h"
+#include "bios.h"
 #include "cpu.h"
 #include "display.h"
+#include "dma.h"
+#include "frame_sink.h"
+#include "interrupts.h"
 #include "memory.h"
+#include "movie.h"
+#include "render_thread.h"
+#include "savestate.h"
+#include "scheduler.h"
+#include "serial.h"
 #include "soundsystem.h"
+#include "timers.h"
+#include "wav_sink.h"
+
+static const char EMULATOR_VERSION[] = "wabaya 0.1";
+
+// https://problemkaputt.de/gbatek.htm#gbakeypadinput
+static const int KEYINPUT = 0x130;
+static const int KEYCNT   = 0x132;
+
+// Dirty save pages are handed to the kernel for write back once per emulated second
+static const uint64_t BACKUP_FLUSH_CYCLES = CPU_FREQUENCY;
+
+static const int FRAMESKIP_AUTO     = -1;
+static const int MAX_AUTO_FRAMESKIP = 9;
+
+static const uint64_t NO_FRAME = ~uint64_t(0);
+
+struct EmulatorOptions {
+    uint64_t frames;    // stop after this many frames, 0 runs forever
+    bool threaded_ppu;  // render scanlines on a worker thread
+    bool headless;      // run at unlimited speed, frames are only rendered for their output
+    int frameskip;      // frames skipped after each rendered frame, or FRAMESKIP_AUTO
+    double speed;       // target speed, 1.0 being the hardware frame rate
+    std::string wav_file;  // sound output, empty for none
+    std::string video_file;   // rendered frames output, empty for none
+    FRAME_FORMAT video_format;
+    bool video_changed_only;  // leave out frames identical to the previous one
+    std::string bios_file;  // BIOS image to run SWIs on, empty to service them natively
+    std::string record_file;  // input movie to record, empty for none
+    std::string replay_file;  // input movie to replay, the run stops at its end
+    uint32_t keyframe_interval;  // frames between the savestates embedded in a recorded movie
+    uint64_t seek_frame;         // frame to start a replay from
+    bool persistent_save;        // map the save to the .sav file next to the ROM, or keep it in memory
+
+    EmulatorOptions()
+        : frames(0), threaded_ppu(false), headless(false), frameskip(0), speed(1.0), video_format(FRAME_RGBA), video_changed_only(false), keyframe_interval(DEFAULT_KEYFRAME_INTERVAL), seek_frame(0), persistent_save(true) {
+    }
+};
 
 class Emulator {
     private:
+    EmulatorOptions options;
     Memory mem;
+    Backup backup;
     CPU cpu;
+    BIOS bios;
+    Display display;
+    Scheduler scheduler;
+    InterruptController interrupts;
+    Serial serial;
+    SoundSystem sound;
+    DMA dma;
+    Timers timers;
+    std::unique_ptr<RenderThread> render_thread;
+    std::unique_ptr<WavSink> wav_sink;
+    std::unique_ptr<FrameSink> frame_sink;
+    Movie movie;
+    halfword keys;         // host key state, latched into KEYINPUT at the start of each frame
+    uint64_t input_frame;  // last frame the keys were latched for
+    bool replay_ended;
+    bool fast_forward;  // seeking, frames are neither rendered nor paced
+    uint64_t frame;
+    uint64_t start_frame;  // first frame of run(), later than 0 after a seek
+    uint64_t frames_rendered;
+    bool render_frame;  // false while the current frame is skipped
+    int frames_skipped;  // consecutive skipped frames
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::time_point end_time;
+
+    static void keypad_io_written(void* owner, int offset, halfword old_value, halfword mask);
+    void open_backup(std::string filename);
+    void open_movie(bool hle_bios);
+    void check_keypad();
+    void latch_input();
+    bool seek(uint64_t target);
+    void step();
+    void sync_state(Savestate& state);
+    void handle_event(EVENT event, uint64_t time);
+    void hblank(uint64_t time);
+    void hdraw(uint64_t time);
+    void end_frame();
+    std::chrono::steady_clock::time_point frame_deadline(uint64_t n);
 
     public:
-    Emulator(std::string filename);
+    Emulator(std::string filename, EmulatorOptions options = EmulatorOptions());
     void mem_dump();
+    void set_keys(halfword keys);
+    void connect_link(LinkCable* cable, int id);
+    uint64_t get_frame() {
+        return frame;
+    }
+    uint64_t state_hash();
+    void report();
     void run();
 };
 
-#endif
\ No newline at end of file
+#endif
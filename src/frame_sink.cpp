@@ -0,0 +1,146 @@
+#include "frame_sink.h"
+
+#include <algorithm>
+
+#include "profiler.h"
+#include "scheduler.h"
+
+static const int FRAME_PIXELS = SCREEN_WIDTH * SCREEN_HEIGHT;
+
+// BGR555 expanded to 8 bits per channel, the top bits repeated in the low ones
+static void expand(halfword color, int& r, int& g, int& b) {
+    r = color & 0x1F;
+    g = (color >> 5) & 0x1F;
+    b = (color >> 10) & 0x1F;
+    r = (r << 3) | (r >> 2);
+    g = (g << 3) | (g >> 2);
+    b = (b << 3) | (b >> 2);
+}
+
+FrameSink::FrameSink(FRAME_FORMAT _format, bool _changed_only)
+    : format(_format), changed_only(_changed_only), running(false), next(0), palette(new word[0x8000]), last_hash(0), has_last(false), frames_written(0), frames_unchanged(0) {
+    full[0] = false;
+    full[1] = false;
+    for (int color = 0; color < 0x8000; color++) {
+        int r, g, b;
+        expand(color, r, g, b);
+        if (format == FRAME_Y4M) {
+            // https://en.wikipedia.org/wiki/YCbCr#ITU-R_BT.601_conversion, studio range
+            word y         = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+            word u         = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+            word v         = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+            palette[color] = y | (u << 8) | (v << 16);
+        } else {
+            palette[color] = r | (g << 8) | (b << 16) | (0xFF << 24);
+        }
+    }
+}
+
+FrameSink::~FrameSink() {
+    stop();
+}
+
+// https://wiki.multimedia.cx/index.php/YUV4MPEG2
+bool FrameSink::open(std::string filename) {
+    file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.good()) return false;
+    if (format == FRAME_Y4M) {
+        file << "YUV4MPEG2 W" << SCREEN_WIDTH << " H" << SCREEN_HEIGHT << " F" << CPU_FREQUENCY << ":"
+             << SCANLINES * (HDRAW_CYCLES + HBLANK_CYCLES) << " Ip A1:1 C444\n";
+    }
+    return true;
+}
+
+void FrameSink::start() {
+    if (running || !file.is_open()) return;
+    running = true;
+    thread  = std::thread(&FrameSink::loop, this);
+}
+
+// Writes the frames still in the buffers, then closes the output
+void FrameSink::stop() {
+    if (!running) return;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        running = false;
+    }
+    changed.notify_all();
+    thread.join();
+    file.close();
+}
+
+// Called once per rendered frame, from the thread that rendered it
+void FrameSink::submit(const halfword* pixels, uint64_t frame) {
+    if (!running) return;
+    ScopedTimer timer(FRAME_OUTPUT);
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this] { return !full[next]; });
+    }
+    // the buffer belongs to this thread until it is marked full
+    FrameBuffer& buffer = buffers[next];
+    buffer.frame        = frame;
+    std::copy(pixels, pixels + FRAME_PIXELS, buffer.pixels);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        full[next] = true;
+    }
+    changed.notify_all();
+    next ^= 1;
+}
+
+void FrameSink::loop() {
+    int current = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [this, current] { return full[current] || !running; });
+            if (!full[current]) break;
+        }
+        write_frame(buffers[current]);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            full[current] = false;
+        }
+        changed.notify_all();
+        current ^= 1;
+    }
+    if (!file.good()) log_warning("Unable to write the video output");
+}
+
+// Runs on the writer thread, the hash and the color conversion stay off the emulation thread
+void FrameSink::write_frame(const FrameBuffer& buffer) {
+    if (changed_only) {
+        uint64_t hash = hash_bytes(buffer.pixels, sizeof(buffer.pixels));
+        if (has_last && hash == last_hash) {
+            frames_unchanged++;
+            profiler.count(FRAME_UNCHANGED);
+            return;
+        }
+        last_hash = hash;
+        has_last  = true;
+    }
+    if (format == FRAME_Y4M) {
+        output.resize(3 * FRAME_PIXELS);
+        for (int i = 0; i < FRAME_PIXELS; i++) {
+            word yuv                     = palette[buffer.pixels[i] & 0x7FFF];
+            output[i]                    = yuv;
+            output[FRAME_PIXELS + i]     = yuv >> 8;
+            output[2 * FRAME_PIXELS + i] = yuv >> 16;
+        }
+        file << "FRAME";
+        if (changed_only) file << " Xframe=" << buffer.frame;
+        file << "\n";
+    } else {
+        output.resize(4 * FRAME_PIXELS);
+        for (int i = 0; i < FRAME_PIXELS; i++) {
+            word rgba         = palette[buffer.pixels[i] & 0x7FFF];
+            output[4 * i]     = rgba;
+            output[4 * i + 1] = rgba >> 8;
+            output[4 * i + 2] = rgba >> 16;
+            output[4 * i + 3] = rgba >> 24;
+        }
+    }
+    file.write(reinterpret_cast<const char*>(output.data()), output.size());
+    frames_written++;
+}
@@ -0,0 +1,68 @@
+#ifndef FRAME_SINK_H
+#define FRAME_SINK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "display.h"
+#include "utils.h"
+
+typedef enum {
+    FRAME_RGBA,  // raw 8 bit RGBA, no header
+    FRAME_Y4M    // YUV4MPEG2, 4:4:4 BT.601
+} FRAME_FORMAT;
+
+struct FrameBuffer {
+    uint64_t frame;
+    halfword pixels[SCREEN_HEIGHT * SCREEN_WIDTH];
+};
+
+// Writes completed frames to a file or a pipe on its own thread. Frames are handed over through two
+// buffers: the emulation thread copies a frame into one while the writer converts and writes the
+// other, and only waits when the writer is a whole frame behind. Both sides sleep on a condition
+// variable while they wait. Optionally, frames identical to the previous one are left out, Y4M frames
+// then carry their number in an Xframe parameter.
+class FrameSink {
+    private:
+    FRAME_FORMAT format;
+    bool changed_only;
+    std::ofstream file;
+    std::thread thread;
+    std::atomic<bool> running;
+    FrameBuffer buffers[2];
+    std::mutex lock;                   // guards full, and running for the waits
+    std::condition_variable changed;  // signalled when a buffer is handed over or released, and on stop
+    bool full[2];                     // handed over to the writer
+    int next;                         // buffer the next frame is copied to
+    std::unique_ptr<word[]> palette;  // BGR555 to RGBA, or to Y, U and V in the low three bytes
+    std::vector<byte> output;         // converted frame, writer thread only
+    uint64_t last_hash;
+    bool has_last;
+    uint64_t frames_written;
+    uint64_t frames_unchanged;
+    void loop();
+    void write_frame(const FrameBuffer& buffer);
+
+    public:
+    FrameSink(FRAME_FORMAT format, bool changed_only);
+    ~FrameSink();
+    bool open(std::string filename);
+    void start();
+    void stop();
+    void submit(const halfword* pixels, uint64_t frame);
+    uint64_t get_frames_written() {
+        return frames_written;
+    }
+    uint64_t get_frames_unchanged() {
+        return frames_unchanged;
+    }
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include "interrupts.h"
+
+InterruptController::InterruptController(Memory& _mem, CPU& _cpu, Scheduler& _scheduler)
+    : mem(_mem), cpu(_cpu), scheduler(_scheduler), pending(false) {
+    mem.set_io_handler(IE, io_written, this);
+    mem.set_io_handler(IF, io_written, this);
+    mem.set_io_handler(IME, io_written, this);
+    cpu.set_interrupt_controller(this);
+}
+
+// Writing 1 to a bit of IF acknowledges the interrupt and clears it
+void InterruptController::io_written(void* owner, int offset, halfword old_value, halfword mask) {
+    InterruptController* self = static_cast<InterruptController*>(owner);
+    if (offset == IF) {
+        halfword& reg = self->mem.io_halfword(IF);
+        reg           = old_value & ~(reg & mask);
+    }
+    self->update();
+}
+
+void InterruptController::request(INTERRUPT irq) {
+    mem.io_halfword(IF) |= 1 << irq;
+    update();
+}
+
+// A halted CPU wakes up on any enabled request, even with IME or the CPSR masking it
+void InterruptController::update() {
+    bool requested = mem.io_halfword(IE) & mem.io_halfword(IF) & 0x3FFF;
+    if (requested && cpu.is_halted()) cpu.wake();
+    pending = requested && (mem.io_halfword(IME) & 1) && !(cpu.get_cpsr() & IRQ_DISABLE);
+    if (pending) {
+        scheduler.schedule_at(EVENT_IRQ, scheduler.now());
+    } else {
+        scheduler.cancel(EVENT_IRQ);
+    }
+}
+
+void InterruptController::service() {
+    if (pending) scheduler.advance(cpu.interrupt());
+}
+
+void InterruptController::sync_state(Savestate& state) {
+    state.sync(pending);
+}
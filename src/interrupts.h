@@ -0,0 +1,48 @@
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+// https://problemkaputt.de/gbatek.htm#gbainterruptcontrol
+#include "cpu.h"
+#include "memory.h"
+#include "savestate.h"
+#include "scheduler.h"
+#include "utils.h"
+
+typedef enum {
+    IRQ_VBLANK,
+    IRQ_HBLANK,
+    IRQ_VCOUNT,
+    IRQ_TIMER0,
+    IRQ_TIMER1,
+    IRQ_TIMER2,
+    IRQ_TIMER3,
+    IRQ_SERIAL,
+    IRQ_DMA0,
+    IRQ_DMA1,
+    IRQ_DMA2,
+    IRQ_DMA3,
+    IRQ_KEYPAD,
+    IRQ_GAMEPAK
+} INTERRUPT;
+
+// Keeps a single pending flag, recomputed only when IE, IF, IME or the CPSR change. When it gets set,
+// an EVENT_IRQ is scheduled at the current cycle, which ends the CPU batch after the instruction that
+// caused it. The CPU itself never checks for interrupts.
+class InterruptController {
+    private:
+    Memory& mem;
+    CPU& cpu;
+    Scheduler& scheduler;
+    bool pending;
+
+    static void io_written(void* owner, int offset, halfword old_value, halfword mask);
+
+    public:
+    InterruptController(Memory& mem, CPU& cpu, Scheduler& scheduler);
+    void request(INTERRUPT irq);
+    void update();
+    void service();
+    void sync_state(Savestate& state);
+};
+
+#endif
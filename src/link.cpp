@@ -0,0 +1,49 @@
+#include "link.h"
+
+#include <algorithm>
+#include <thread>
+
+LinkCable::LinkCable(int _units, uint64_t _lookahead)
+    : units(_units), lookahead(_lookahead), clocks(new LinkClock[_units]) {
+    for (int i = 0; i < units * units; i++) {
+        queues.push_back(std::make_unique<LinkQueue>());
+    }
+    for (int i = 0; i < units; i++) {
+        clocks[i].time.store(0, std::memory_order_relaxed);
+    }
+}
+
+// Waits for room when the queue is full, the receiver drains its queues even while it waits for us.
+// Messages to a unit that left the link are dropped.
+void LinkCable::send(int from, int to, const LinkMessage& message) {
+    LinkQueue& queue = *queues[from * units + to];
+    while (!queue.push(message)) {
+        if (clocks[to].time.load(std::memory_order_acquire) == LINK_DISCONNECTED) return;
+        std::this_thread::yield();
+    }
+}
+
+void LinkCable::receive(int unit, std::vector<LinkMessage>& messages) {
+    LinkMessage message;
+    for (int from = 0; from < units; from++) {
+        LinkQueue& queue = *queues[from * units + unit];
+        while (queue.pop(message)) {
+            messages.push_back(message);
+        }
+    }
+}
+
+// The messages of a unit are queued before the time that follows them is published
+void LinkCable::publish(int unit, uint64_t time) {
+    clocks[unit].time.store(time, std::memory_order_release);
+}
+
+// First cycle another unit could still send a message for. Receiving after reading the clocks is
+// guaranteed to return every message that takes effect before it.
+uint64_t LinkCable::horizon(int unit) {
+    uint64_t slowest = LINK_DISCONNECTED;
+    for (int i = 0; i < units; i++) {
+        if (i != unit) slowest = std::min(slowest, clocks[i].time.load(std::memory_order_acquire));
+    }
+    return slowest == LINK_DISCONNECTED ? LINK_DISCONNECTED : slowest + lookahead;
+}
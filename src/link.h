@@ -0,0 +1,62 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "spsc_queue.h"
+#include "utils.h"
+
+static const int LINK_MAX_UNITS              = 4;
+static const uint64_t DEFAULT_LINK_LOOKAHEAD = 4096;  // cycles, about 244 us
+static const uint64_t LINK_DISCONNECTED      = ~uint64_t(0);
+
+typedef enum {
+    LINK_START,  // the sender started a transfer, value is its outgoing data
+    LINK_DATA    // answer to a LINK_START, value is the outgoing data of the sender
+} LINK_MESSAGE;
+
+struct LinkMessage {
+    LINK_MESSAGE type;
+    int sender;
+    uint64_t time;  // cycle the message takes effect at on the receiver
+    uint64_t end;   // cycle the transfer completes at, on every unit
+    word value;
+};
+
+typedef SPSCQueue<LinkMessage, 256> LinkQueue;
+
+struct alignas(64) LinkClock {
+    std::atomic<uint64_t> time;
+};
+
+// Connects the serial ports of emulators running on their own threads. Each ordered pair of units has
+// a lock-free queue, and each unit publishes the cycle it has reached. Synchronization is conservative
+// with a lookahead of L cycles: a message sent at cycle T takes effect at T + L on the receiver, and a
+// unit never runs past the slowest other unit plus L. Every message is therefore queued before its
+// receiver gets to it, and takes effect at a cycle that only depends on the emulation, so linked runs
+// are deterministic. The threads only wait on each other when one gets L cycles ahead.
+class LinkCable {
+    private:
+    int units;
+    uint64_t lookahead;
+    std::vector<std::unique_ptr<LinkQueue>> queues;  // from * units + to
+    std::unique_ptr<LinkClock[]> clocks;
+
+    public:
+    LinkCable(int units, uint64_t lookahead);
+    int get_units() {
+        return units;
+    }
+    uint64_t get_lookahead() {
+        return lookahead;
+    }
+    void send(int from, int to, const LinkMessage& message);
+    void receive(int unit, std::vector<LinkMessage>& messages);
+    void publish(int unit, uint64_t time);
+    uint64_t horizon(int unit);
+};
+
+#endif
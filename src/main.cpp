@@ -1,14 +1,135 @@
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "emulator.h"
+#include "link.h"
+#include "profiler.h"
+
+static void print_usage() {
+    std::cout << "Usage: wabaya [options] <rom filename>\n";
+    std::cout << "Options:\n";
+    std::cout << "    --frames <n>      stop after n frames and report the frame rate\n";
+    std::cout << "    --threaded-ppu    render scanlines on a separate thread\n";
+    std::cout << "    --headless        run at unlimited speed\n";
+    std::cout << "    --frameskip <n>   render one frame out of n + 1, or auto to skip when below the target speed\n";
+    std::cout << "    --speed <x>       target speed, 1 being the hardware frame rate\n";
+    std::cout << "    --wav <file>      write the sound output to a WAV file\n";
+    std::cout << "    --video <file>    write the rendered frames to a file or a pipe, Y4M for a .y4m file, raw RGBA otherwise\n";
+    std::cout << "    --video-format <f> y4m or rgba, instead of the format picked from the file name\n";
+    std::cout << "    --video-changed   leave out video frames identical to the previous one\n";
+    std::cout << "    --bios <file>     run the BIOS calls on a BIOS image instead of emulating them natively\n";
+    std::cout << "    --record <file>   record the keys of every frame to an input movie\n";
+    std::cout << "    --keyframes <n>   frames between the savestates embedded in a recorded movie\n";
+    std::cout << "    --replay <file>   replay an input movie, stopping at its end\n";
+    std::cout << "    --seek <frame>    start the replay at this frame\n";
+    std::cout << "    --link <n>        run n linked instances of the game, 2 to 4, on their own threads\n";
+    std::cout << "    --lookahead <n>   cycles a linked instance can run ahead of the others\n";
+    std::cout << "Exiting\n";
+}
+
+// Linked instances run on their own threads. Only the first one keeps the save file, the sound and
+// the video output, the others start from an erased save.
+static void run_linked(std::string filename, EmulatorOptions options, int units, uint64_t lookahead) {
+    LinkCable cable(units, lookahead);
+    std::vector<std::unique_ptr<Emulator>> emulators;
+    for (int i = 0; i < units; i++) {
+        EmulatorOptions unit_options = options;
+        if (i > 0) {
+            unit_options.wav_file.clear();
+            unit_options.video_file.clear();
+            unit_options.persistent_save = false;
+        }
+        emulators.push_back(std::make_unique<Emulator>(filename, unit_options));
+        emulators.back()->connect_link(&cable, i);
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (auto& emu : emulators) {
+        threads.emplace_back(&Emulator::run, emu.get());
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    uint64_t frames                       = 0;
+    for (int i = 0; i < units; i++) {
+        frames += emulators[i]->get_frame();
+        std::cout << "unit " << i << ": " << emulators[i]->get_frame() << " frames, state hash " << std::hex << emulators[i]->state_hash() << std::dec << "\n";
+    }
+    std::cout << units << " linked instances, lookahead " << lookahead << " cycles: " << frames << " frames in " << elapsed.count() << " s, "
+              << frames / elapsed.count() << " fps total, " << frames / elapsed.count() / units << " fps per instance\n";
+    profiler.report();
+}
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        std::cout << "Usage: wabaya <rom filename>\n";
-        std::cout << "Exiting\n";
+    EmulatorOptions options;
+    std::string filename;
+    int link_units     = 1;
+    uint64_t lookahead = DEFAULT_LINK_LOOKAHEAD;
+    std::string video_format;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) {
+            options.frames = std::stoull(argv[++i]);
+        } else if (arg == "--threaded-ppu") {
+            options.threaded_ppu = true;
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--frameskip" && i + 1 < argc) {
+            std::string value = argv[++i];
+            options.frameskip = value == "auto" ? FRAMESKIP_AUTO : std::stoi(value);
+        } else if (arg == "--speed" && i + 1 < argc) {
+            options.speed = std::stod(argv[++i]);
+        } else if (arg == "--wav" && i + 1 < argc) {
+            options.wav_file = argv[++i];
+        } else if (arg == "--video" && i + 1 < argc) {
+            options.video_file = argv[++i];
+        } else if (arg == "--video-format" && i + 1 < argc) {
+            video_format = argv[++i];
+        } else if (arg == "--video-changed") {
+            options.video_changed_only = true;
+        } else if (arg == "--bios" && i + 1 < argc) {
+            options.bios_file = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            options.record_file = argv[++i];
+        } else if (arg == "--keyframes" && i + 1 < argc) {
+            options.keyframe_interval = std::stoul(argv[++i]);
+        } else if (arg == "--replay" && i + 1 < argc) {
+            options.replay_file = argv[++i];
+        } else if (arg == "--seek" && i + 1 < argc) {
+            options.seek_frame = std::stoull(argv[++i]);
+        } else if (arg == "--link" && i + 1 < argc) {
+            link_units = std::stoi(argv[++i]);
+        } else if (arg == "--lookahead" && i + 1 < argc) {
+            lookahead = std::stoull(argv[++i]);
+        } else if (filename.empty() && arg[0] != '-') {
+            filename = arg;
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    size_t length = options.video_file.size();
+    if (video_format.empty()) video_format = length >= 4 && options.video_file.compare(length - 4, 4, ".y4m") == 0 ? "y4m" : "rgba";
+    options.video_format = video_format == "y4m" ? FRAME_Y4M : FRAME_RGBA;
+    bool has_movie      = !options.record_file.empty() || !options.replay_file.empty();
+    bool movie_conflict = !options.record_file.empty() && !options.replay_file.empty();
+    bool bad_link       = link_units < 1 || link_units > LINK_MAX_UNITS || lookahead == 0 || (link_units > 1 && has_movie);
+    bool bad_video      = video_format != "y4m" && video_format != "rgba";
+    if (filename.empty() || options.frameskip < FRAMESKIP_AUTO || options.speed <= 0 || options.keyframe_interval == 0 || movie_conflict || bad_link || bad_video) {
+        print_usage();
         return 1;
     }
-    Emulator emu = Emulator(argv[1]);
+    if (link_units > 1) {
+        run_linked(filename, options, link_units, lookahead);
+        return 0;
+    }
+    Emulator emu = Emulator(filename, options);
     emu.run();
+    emu.report();
     return 0;
-}
\ No newline at end of file
+}
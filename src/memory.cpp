@@ -1,20 +1,28 @@
 #include "memory.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+
 #include "utils.h"
 
 Memory::Memory() {
-    sys_rom  = new byte[0x4000];
-    ewram    = new byte[0x40000];
-    iwram    = new byte[0x8000];
-    io_ram   = new byte[0x400];
-    pal_ram  = new byte[0x400];
-    vram     = new byte[0x18000];
-    oam      = new byte[0x400];
-    pak_rom  = new byte[0x2000000];
-    cart_rom = new byte[0x10000];
-    // load game data in pak rom, save data in cart_rom, zero out rest of memory except bios maybe
+    // everything starts zeroed, a run must not depend on what the allocator left behind
+    sys_rom  = new byte[0x4000]();
+    ewram    = new byte[0x40000]();
+    iwram    = new byte[0x8000]();
+    io_ram   = new byte[0x400]();
+    pal_ram  = new byte[0x400]();
+    vram     = new byte[0x18000]();
+    oam      = new byte[0x400]();
+    pak_rom  = new byte[0x2000000]();
+    cart_rom = new byte[0x10000]();
+    // everything starts dirty so the render thread copies the whole video memory once
+    mark_all_video_dirty();
+    write_count = 0;
+    backup      = nullptr;
+    rom_size    = 0;
+    std::fill(io_handlers, io_handlers + IO_HALFWORD_COUNT, IOHandler{nullptr, nullptr, nullptr});
 }
 
 Memory::~Memory() {
@@ -29,101 +37,327 @@ Memory::~Memory() {
     delete[] cart_rom;
 }
 
+void Memory::mark_all_video_dirty() {
+    std::fill(video_dirty, video_dirty + (VIDEO_BLOCK_COUNT + 63) / 64, ~uint64_t(0));
+    video_dirty[VIDEO_BLOCK_COUNT / 64] = (uint64_t(1) << (VIDEO_BLOCK_COUNT % 64)) - 1;
+}
+
+// The ROMs are not part of the state, and cart_rom only when no backup stands in for it
+void Memory::sync_state(Savestate& state) {
+    state.sync_bytes(ewram, 0x40000);
+    state.sync_bytes(iwram, 0x8000);
+    state.sync_bytes(io_ram, 0x400);
+    state.sync_bytes(pal_ram, 0x400);
+    state.sync_bytes(vram, 0x18000);
+    state.sync_bytes(oam, 0x400);
+    if (backup == nullptr) state.sync_bytes(cart_rom, 0x10000);
+    state.sync(write_count);
+    if (state.is_loading()) mark_all_video_dirty();
+}
+
 byte Memory::operator[](const size_t index) {
-    if (SYS_ROM_START <= index && index <= SYS_ROM_END) {
-        return sys_rom[index - SYS_ROM_START];
-    } else if (EWRAM_START <= index && index <= EWRAM_END) {
-        return ewram[index - EWRAM_START];
-    } else if (IWRAM_START <= index && index <= IWRAM_END) {
-        return iwram[index - IWRAM_START];
-    } else if (IO_RAM_START <= index && index <= IO_RAM_END) {
-        return io_ram[index - IO_RAM_START];
-    } else if (PAL_RAM_START <= index && index <= PAL_RAM_END) {
-        return pal_ram[index - PAL_RAM_START];
-    } else if (VRAM_START <= index && index <= VRAM_END) {
-        return vram[index - VRAM_START];
-    } else if (OAM_START <= index && index <= OAM_END) {
-        return oam[index - OAM_START];
-    } else if (PAK_ROM_WAIT_STATE_0_START <= index && index <= PAK_ROM_WAIT_STATE_0_END) {
-        return pak_rom[index - PAK_ROM_WAIT_STATE_0_START];
-    } else if (PAK_ROM_WAIT_STATE_1_START <= index && index <= PAK_ROM_WAIT_STATE_1_END) {
-        return pak_rom[index - PAK_ROM_WAIT_STATE_1_START];
-    } else if (PAK_ROM_WAIT_STATE_2_START <= index && index <= PAK_ROM_WAIT_STATE_2_END) {
-        return pak_rom[index - PAK_ROM_WAIT_STATE_2_START];
-    } else if (CART_ROM_START <= index && index <= CART_ROM_END) {
-        return cart_rom[index - CART_ROM_START];
-    } else {
+    if (IO_RAM_START <= index && index <= IO_RAM_END) io_read(index - IO_RAM_START);
+    if (is_backup(index)) return read_backup(index, 1);
+    size_t available;
+    byte* p = get_pointer(index, available);
+    if (p == nullptr) {
         log_error("Accessing invalid memory address");
         return 0;
     }
+    return *p;
 }
 
 word Memory::get_word(const size_t index) {
-    if (SYS_ROM_START <= index && index <= SYS_ROM_END) {
-        return reinterpret_cast<word*>(sys_rom)[index - SYS_ROM_START];
-    } else if (EWRAM_START <= index && index <= EWRAM_END) {
-        return reinterpret_cast<word*>(ewram)[index - EWRAM_START];
-    } else if (IWRAM_START <= index && index <= IWRAM_END) {
-        return reinterpret_cast<word*>(iwram)[index - IWRAM_START];
-    } else if (IO_RAM_START <= index && index <= IO_RAM_END) {
-        return reinterpret_cast<word*>(io_ram)[index - IO_RAM_START];
-    } else if (PAL_RAM_START <= index && index <= PAL_RAM_END) {
-        return reinterpret_cast<word*>(pal_ram)[index - PAL_RAM_START];
-    } else if (VRAM_START <= index && index <= VRAM_END) {
-        return reinterpret_cast<word*>(vram)[index - VRAM_START];
-    } else if (OAM_START <= index && index <= OAM_END) {
-        return reinterpret_cast<word*>(oam)[index - OAM_START];
-    } else if (PAK_ROM_WAIT_STATE_0_START <= index && index <= PAK_ROM_WAIT_STATE_0_END) {
-        return reinterpret_cast<word*>(pak_rom)[index - PAK_ROM_WAIT_STATE_0_START];
-    } else if (PAK_ROM_WAIT_STATE_1_START <= index && index <= PAK_ROM_WAIT_STATE_1_END) {
-        return reinterpret_cast<word*>(pak_rom)[index - PAK_ROM_WAIT_STATE_1_START];
-    } else if (PAK_ROM_WAIT_STATE_2_START <= index && index <= PAK_ROM_WAIT_STATE_2_END) {
-        return reinterpret_cast<word*>(pak_rom)[index - PAK_ROM_WAIT_STATE_2_START];
-    } else if (CART_ROM_START <= index && index <= CART_ROM_END) {
-        return reinterpret_cast<word*>(cart_rom)[index - CART_ROM_START];
-    } else {
+    if (IO_RAM_START <= index && index <= IO_RAM_END) {
+        // word accesses are aligned, both halves stay inside the IO registers
+        size_t offset = (index - IO_RAM_START) & ~3;
+        io_read(offset);
+        io_read(offset + 2);
+    }
+    if (is_backup(index)) return read_backup(index, 4);
+    size_t available;
+    byte* p = get_pointer(index, available);
+    if (p == nullptr || available < 4) {
         log_error("Accessing invalid memory address");
         return 0;
     }
+    return *reinterpret_cast<word*>(p);
 }
 
 halfword Memory::get_halfword(const size_t index) {
+    if (IO_RAM_START <= index && index <= IO_RAM_END) io_read(index - IO_RAM_START);
+    if (is_backup(index)) return read_backup(index, 2);
+    size_t available;
+    byte* p = get_pointer(index, available);
+    if (p == nullptr || available < 2) {
+        log_error("Accessing invalid memory address");
+        return 0;
+    }
+    return *reinterpret_cast<halfword*>(p);
+}
+
+static bool is_rom(const size_t index) {
+    return index <= SYS_ROM_END || (PAK_ROM_WAIT_STATE_0_START <= index && index <= PAK_ROM_WAIT_STATE_2_END);
+}
+
+// https://problemkaputt.de/gbatek.htm#gbamemorymap
+// Byte writes to PAL and VRAM store the byte in both halves of the halfword, byte writes to OAM are ignored
+void Memory::set_byte(const size_t index, byte value) {
+    write_count++;
+    if (is_backup(index)) {
+        write_backup(index, value, 1);
+        return;
+    }
+    if (is_rom(index)) return;
+    if (IO_RAM_START <= index && index <= IO_RAM_END) {
+        int shift = (index & 1) * 8;
+        io_write((index - IO_RAM_START) & ~1, value << shift, 0xFF << shift);
+        return;
+    }
+    if (PAL_RAM_START <= index && index <= VRAM_END) {
+        set_halfword(index & ~1, value | value << 8);
+        return;
+    }
+    if (OAM_START <= index && index <= OAM_END) return;
+    size_t available;
+    byte* p = get_pointer(index, available);
+    if (p == nullptr) {
+        log_error("Writing invalid memory address");
+        return;
+    }
+    *p = value;
+    mark_video_dirty(index, 1);
+}
+
+void Memory::set_halfword(const size_t index, halfword value) {
+    write_count++;
+    if (is_backup(index)) {
+        write_backup(index, value, 2);
+        return;
+    }
+    if (is_rom(index)) return;
+    if (IO_RAM_START <= index && index <= IO_RAM_END) {
+        io_write((index - IO_RAM_START) & ~1, value, 0xFFFF);
+        return;
+    }
+    size_t available;
+    byte* p = get_pointer(index, available);
+    if (p == nullptr || available < 2) {
+        log_error("Writing invalid memory address");
+        return;
+    }
+    *reinterpret_cast<halfword*>(p) = value;
+    mark_video_dirty(index, 2);
+}
+
+void Memory::set_word(const size_t index, word value) {
+    write_count++;
+    if (is_backup(index)) {
+        write_backup(index, value, 4);
+        return;
+    }
+    if (is_rom(index)) return;
+    if (IO_RAM_START <= index && index <= IO_RAM_END) {
+        size_t offset = (index - IO_RAM_START) & ~3;
+        io_write(offset, value, 0xFFFF);
+        io_write(offset + 2, value >> 16, 0xFFFF);
+        return;
+    }
+    size_t available;
+    byte* p = get_pointer(index, available);
+    if (p == nullptr || available < 4) {
+        log_error("Writing invalid memory address");
+        return;
+    }
+    *reinterpret_cast<word*>(p) = value;
+    mark_video_dirty(index, 4);
+}
+
+// https://problemkaputt.de/gbatek.htm#gbacartbackupids
+// SRAM and Flash have an 8 bit bus: wider reads repeat the byte, wider writes store the byte on the
+// address lane. The EEPROM transfers one bit per halfword.
+word Memory::read_backup(const size_t index, int width) {
+    if ((index >> 24) == 0x0D) return backup->eeprom_read();
+    word value = backup->read_byte(index);
+    return width == 1 ? value : value * (width == 2 ? 0x0101 : 0x01010101);
+}
+
+void Memory::write_backup(const size_t index, word value, int width) {
+    if ((index >> 24) == 0x0D) {
+        backup->eeprom_write(value);
+        return;
+    }
+    backup->write_byte(index, value >> ((index & (width - 1)) * 8));
+}
+
+void Memory::set_backup(Backup* _backup) {
+    backup = _backup;
+}
+
+// Like get_pointer, but only for regions where accesses have no side effects: not IO, and not ROM when
+// writing. Bulk transfers use it to copy directly between backing arrays.
+byte* Memory::get_plain_pointer(const size_t index, size_t& available, bool write) {
+    if ((IO_RAM_START <= index && index <= IO_RAM_END) || (write && is_rom(index)) || is_backup(index)) {
+        available = 0;
+        return nullptr;
+    }
+    if (write) write_count++;
+    return get_pointer(index, available);
+}
+
+// https://problemkaputt.de/gbatek.htm#gbamemorymap
+// Approximate access time of a width bytes access, with the default WAITCNT settings
+int Memory::access_cycles(const size_t index, int width, bool sequential) {
+    switch (index >> 24) {
+        case 0x02:
+            return width == 4 ? 6 : 3;
+        case 0x05:
+        case 0x06:
+            return width == 4 ? 2 : 1;
+        case 0x08:
+        case 0x09:
+        case 0x0A:
+        case 0x0B:
+        case 0x0C:
+        case 0x0D: {
+            int first = sequential ? 3 : 5;
+            return width == 4 ? first + 3 : first;
+        }
+        case 0x0E:
+            return 5;
+        default:
+            return 1;
+    }
+}
+
+// Resolves index to its backing storage, available is set to the number of bytes left in the region
+byte* Memory::get_pointer(const size_t index, size_t& available) {
     if (SYS_ROM_START <= index && index <= SYS_ROM_END) {
-        return reinterpret_cast<halfword*>(sys_rom)[index - SYS_ROM_START];
-    } else if (EWRAM_START <= index && index <= EWRAM_END) {
-        return reinterpret_cast<halfword*>(ewram)[index - EWRAM_START];
-    } else if (IWRAM_START <= index && index <= IWRAM_END) {
-        return reinterpret_cast<halfword*>(iwram)[index - IWRAM_START];
+        available = SYS_ROM_END + 1 - index;
+        return sys_rom + (index - SYS_ROM_START);
+    } else if ((index >> 24) == 0x02) {
+        // EWRAM and IWRAM are mirrored through their whole 16MB area
+        size_t offset = index & (EWRAM_END - EWRAM_START);
+        available     = EWRAM_END - EWRAM_START + 1 - offset;
+        return ewram + offset;
+    } else if ((index >> 24) == 0x03) {
+        size_t offset = index & (IWRAM_END - IWRAM_START);
+        available     = IWRAM_END - IWRAM_START + 1 - offset;
+        return iwram + offset;
     } else if (IO_RAM_START <= index && index <= IO_RAM_END) {
-        return reinterpret_cast<halfword*>(io_ram)[index - IO_RAM_START];
+        available = IO_RAM_END + 1 - index;
+        return io_ram + (index - IO_RAM_START);
     } else if (PAL_RAM_START <= index && index <= PAL_RAM_END) {
-        return reinterpret_cast<halfword*>(pal_ram)[index - PAL_RAM_START];
+        available = PAL_RAM_END + 1 - index;
+        return pal_ram + (index - PAL_RAM_START);
     } else if (VRAM_START <= index && index <= VRAM_END) {
-        return reinterpret_cast<halfword*>(vram)[index - VRAM_START];
+        available = VRAM_END + 1 - index;
+        return vram + (index - VRAM_START);
     } else if (OAM_START <= index && index <= OAM_END) {
-        return reinterpret_cast<halfword*>(oam)[index - OAM_START];
+        available = OAM_END + 1 - index;
+        return oam + (index - OAM_START);
     } else if (PAK_ROM_WAIT_STATE_0_START <= index && index <= PAK_ROM_WAIT_STATE_0_END) {
-        return reinterpret_cast<halfword*>(pak_rom)[index - PAK_ROM_WAIT_STATE_0_START];
+        available = PAK_ROM_WAIT_STATE_0_END + 1 - index;
+        return pak_rom + (index - PAK_ROM_WAIT_STATE_0_START);
     } else if (PAK_ROM_WAIT_STATE_1_START <= index && index <= PAK_ROM_WAIT_STATE_1_END) {
-        return reinterpret_cast<halfword*>(pak_rom)[index - PAK_ROM_WAIT_STATE_1_START];
+        available = PAK_ROM_WAIT_STATE_1_END + 1 - index;
+        return pak_rom + (index - PAK_ROM_WAIT_STATE_1_START);
     } else if (PAK_ROM_WAIT_STATE_2_START <= index && index <= PAK_ROM_WAIT_STATE_2_END) {
-        return reinterpret_cast<halfword*>(pak_rom)[index - PAK_ROM_WAIT_STATE_2_START];
+        available = PAK_ROM_WAIT_STATE_2_END + 1 - index;
+        return pak_rom + (index - PAK_ROM_WAIT_STATE_2_START);
     } else if (CART_ROM_START <= index && index <= CART_ROM_END) {
-        return reinterpret_cast<halfword*>(cart_rom)[index - CART_ROM_START];
+        available = CART_ROM_END + 1 - index;
+        return cart_rom + (index - CART_ROM_START);
     } else {
-        log_error("Accessing invalid memory address");
-        return 0;
+        available = 0;
+        return nullptr;
+    }
+}
+
+halfword& Memory::io_halfword(const size_t offset) {
+    return *reinterpret_cast<halfword*>(io_ram + offset);
+}
+
+word& Memory::io_word(const size_t offset) {
+    return *reinterpret_cast<word*>(io_ram + offset);
+}
+
+// https://problemkaputt.de/gbatek.htm#gbaiomap
+// Every write is merged into the stored halfword first, so handlers always see the full register. Word
+// writes are dispatched as two halfword writes, low half first.
+void Memory::io_write(const size_t offset, halfword value, halfword mask) {
+    halfword& reg      = io_halfword(offset);
+    halfword old       = reg;
+    reg                = (old & ~mask) | (value & mask);
+    IOHandler& handler = io_handlers[offset >> 1];
+    if (handler.write != nullptr) handler.write(handler.owner, offset, old, mask);
+}
+
+// Reads refreshed by a handler can change without any write, they count as writes for idle loop detection
+void Memory::io_read(const size_t offset) {
+    IOHandler& handler = io_handlers[offset >> 1];
+    if (handler.read == nullptr) return;
+    write_count++;
+    handler.read(handler.owner, offset & ~1);
+}
+
+void Memory::set_io_handler(const size_t offset, IO_WRITE_HANDLER handler, void* owner) {
+    io_handlers[offset >> 1].write = handler;
+    io_handlers[offset >> 1].owner = owner;
+}
+
+void Memory::set_io_read_handler(const size_t offset, IO_READ_HANDLER handler, void* owner) {
+    io_handlers[offset >> 1].read  = handler;
+    io_handlers[offset >> 1].owner = owner;
+}
+
+// Offsets in the video memory layout: PAL, VRAM then OAM
+static size_t video_offset(const size_t index) {
+    if (PAL_RAM_START <= index && index <= PAL_RAM_END) return index - PAL_RAM_START;
+    if (VRAM_START <= index && index <= VRAM_END) return 0x400 + index - VRAM_START;
+    if (OAM_START <= index && index <= OAM_END) return 0x18400 + index - OAM_START;
+    return VIDEO_MEMORY_SIZE;
+}
+
+// Must be called after every write to PAL, VRAM or OAM. Bulk writers call it once for the whole range
+void Memory::mark_video_dirty(const size_t index, size_t length) {
+    size_t offset = video_offset(index);
+    if (offset == VIDEO_MEMORY_SIZE || length == 0) return;
+    size_t first = offset / VIDEO_BLOCK_SIZE;
+    size_t last  = std::min(offset + length - 1, static_cast<size_t>(VIDEO_MEMORY_SIZE - 1)) / VIDEO_BLOCK_SIZE;
+    for (size_t block = first; block <= last; block++) {
+        video_dirty[block / 64] |= uint64_t(1) << (block % 64);
     }
 }
 
+// Appends the dirty video blocks to blocks and clears them
+void Memory::take_video_dirty(std::vector<int>& blocks) {
+    for (size_t i = 0; i < (VIDEO_BLOCK_COUNT + 63) / 64; i++) {
+        uint64_t bits = video_dirty[i];
+        while (bits) {
+            blocks.push_back(i * 64 + __builtin_ctzll(bits));
+            bits &= bits - 1;
+        }
+        video_dirty[i] = 0;
+    }
+}
+
+const byte* Memory::get_video_block(int block) {
+    size_t offset = block * VIDEO_BLOCK_SIZE;
+    if (offset < 0x400) return pal_ram + offset;
+    if (offset < 0x18400) return vram + offset - 0x400;
+    return oam + offset - 0x18400;
+}
+
 bool Memory::load_game(std::string filename) {
     std::ifstream file;  // we use ifstream (aka basic_ifstream<char>) instead of basic_ifstream<byte> (aka
                          // basic_ifstream<unsigned char>) because there is no trait implementation for unsigned char.
     file.open(filename, std::ios::in | std::ios::binary | std::ios::ate);
-    size_t size = file.tellg();
+    size_t size = std::min<size_t>(file.tellg(), 0x2000000);
     file.seekg(0, std::ios::beg);
     if (file.good()) {
         file.read(reinterpret_cast<char*>(pak_rom), size);  // as a result, we reinterpret cast the unsigned char* to a char* to make things work
+        rom_size = size;
         file.close();
         return true;
     } else {
@@ -132,6 +366,20 @@ bool Memory::load_game(std::string filename) {
     }
 }
 
+// The BIOS image must be exactly the 16KB of the system ROM
+bool Memory::load_bios(std::string filename) {
+    std::ifstream file;
+    file.open(filename, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!file.good() || file.tellg() != SYS_ROM_END + 1) {
+        file.close();
+        return false;
+    }
+    file.seekg(0, std::ios::beg);
+    file.read(reinterpret_cast<char*>(sys_rom), SYS_ROM_END + 1);
+    file.close();
+    return true;
+}
+
 std::ostream& operator<<(std::ostream& os, const Memory& mem) {
     os.write(reinterpret_cast<char*>(mem.sys_rom), 0x4000);
     os.write(reinterpret_cast<char*>(mem.ewram), 0x40000);
@@ -2,8 +2,12 @@
 #define MEMORY_H
 
 #include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 
+#include "backup.h"
+#include "savestate.h"
 #include "utils.h"
 
 static const int SYS_ROM_START              = 0x0000000;
@@ -29,6 +33,30 @@ static const int PAK_ROM_WAIT_STATE_2_END   = 0xDFFFFFF;
 static const int CART_ROM_START             = 0xE000000;
 static const int CART_ROM_END               = 0xE00FFFF;
 
+// IO registers shared between subsystems, relative to IO_RAM_START
+static const int IE  = 0x200;
+static const int IF  = 0x202;
+static const int IME = 0x208;
+
+// Called after a write to the IO halfword at offset, once the merged value is stored. old_value is the
+// previous contents and mask has the bits that were written
+typedef void (*IO_WRITE_HANDLER)(void* owner, int offset, halfword old_value, halfword mask);
+// Called before the IO halfword at offset is read, to refresh registers computed on demand
+typedef void (*IO_READ_HANDLER)(void* owner, int offset);
+
+struct IOHandler {
+    IO_WRITE_HANDLER write;
+    IO_READ_HANDLER read;
+    void* owner;
+};
+
+static const int IO_HALFWORD_COUNT = (IO_RAM_END + 1 - IO_RAM_START) / 2;
+
+// Video memory (PAL, VRAM then OAM) dirty tracking, used to forward writes to the render thread
+static const int VIDEO_MEMORY_SIZE = 0x400 + 0x18000 + 0x400;
+static const int VIDEO_BLOCK_SIZE  = 64;
+static const int VIDEO_BLOCK_COUNT = VIDEO_MEMORY_SIZE / VIDEO_BLOCK_SIZE;
+
 class Memory {
     private:
     byte *sys_rom;
@@ -40,6 +68,21 @@ class Memory {
     byte *oam;
     byte *pak_rom;
     byte *cart_rom;
+    uint64_t video_dirty[(VIDEO_BLOCK_COUNT + 63) / 64];
+    uint64_t write_count;  // bumped by every write, and by reads with side effects
+    IOHandler io_handlers[IO_HALFWORD_COUNT];  // no handler for plain registers
+    Backup* backup;   // cartridge save memory, the bare cart_rom array is used without one
+    size_t rom_size;
+
+    bool is_backup(const size_t index) {
+        return backup != nullptr && index >= PAK_ROM_WAIT_STATE_2_START && backup->maps(index);
+    }
+    word read_backup(const size_t index, int width);
+    void write_backup(const size_t index, word value, int width);
+
+    void mark_all_video_dirty();
+    void io_write(const size_t offset, halfword value, halfword mask);
+    void io_read(const size_t offset);
 
     public:
     Memory();
@@ -47,7 +90,29 @@ class Memory {
     byte operator[](const size_t index);
     word get_word(const size_t index);
     halfword get_halfword(const size_t index);
+    void set_byte(const size_t index, byte value);
+    void set_halfword(const size_t index, halfword value);
+    void set_word(const size_t index, word value);
+    byte* get_pointer(const size_t index, size_t& available);
+    byte* get_plain_pointer(const size_t index, size_t& available, bool write);
+    int access_cycles(const size_t index, int width, bool sequential);
+    halfword& io_halfword(const size_t offset);
+    word& io_word(const size_t offset);
+    void set_io_handler(const size_t offset, IO_WRITE_HANDLER handler, void* owner);
+    void set_io_read_handler(const size_t offset, IO_READ_HANDLER handler, void* owner);
+    void mark_video_dirty(const size_t index, size_t length);
+    void take_video_dirty(std::vector<int>& blocks);
+    const byte* get_video_block(int block);
+    uint64_t get_write_count() {
+        return write_count;
+    }
+    void set_backup(Backup* backup);
+    size_t get_rom_size() {
+        return rom_size;
+    }
     bool load_game(std::string filename);
+    bool load_bios(std::string filename);
+    void sync_state(Savestate& state);
     friend std::ostream &operator<<(std::ostream &os, const Memory &mem);
 };
 
@@ -0,0 +1,147 @@
+#include "movie.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const char MOVIE_MAGIC[4] = {'W', 'B', 'Y', 'M'};
+
+template <typename T>
+static void put(std::fstream& file, T value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool get(std::fstream& file, T& value) {
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+Movie::Movie()
+    : mode(MOVIE_NONE), header(), block_start(0) {
+}
+
+Movie::~Movie() {
+    close();
+}
+
+bool Movie::record(std::string filename, const MovieHeader& _header) {
+    close();
+    file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.good()) return false;
+    header = _header;
+    char version[MOVIE_VERSION_SIZE] = {};
+    std::strncpy(version, header.version.c_str(), MOVIE_VERSION_SIZE - 1);
+    file.write(MOVIE_MAGIC, 4);
+    put(file, MOVIE_FORMAT);
+    file.write(version, MOVIE_VERSION_SIZE);
+    put(file, header.rom_hash);
+    put(file, header.flags);
+    put(file, header.keyframe_interval);
+    mode = MOVIE_RECORD;
+    return file.good();
+}
+
+// Reads the header and the keys of every block, skipping over the keyframes. A movie made from another
+// ROM is refused, other mismatches only warn since the replay may still go through.
+bool Movie::replay(std::string filename, const MovieHeader& expected) {
+    close();
+    file.open(filename, std::ios::in | std::ios::binary);
+    if (!file.good()) return false;
+    char magic[4];
+    uint32_t format;
+    char version[MOVIE_VERSION_SIZE];
+    file.read(magic, 4);
+    get(file, format);
+    file.read(version, MOVIE_VERSION_SIZE);
+    get(file, header.rom_hash);
+    get(file, header.flags);
+    if (!get(file, header.keyframe_interval) || std::memcmp(magic, MOVIE_MAGIC, 4) != 0 || format != MOVIE_FORMAT || header.keyframe_interval == 0) {
+        log_error(filename + " is not a movie of this format");
+        file.close();
+        return false;
+    }
+    version[MOVIE_VERSION_SIZE - 1] = 0;
+    header.version                  = version;
+    if (header.rom_hash != expected.rom_hash) {
+        log_error(filename + " was recorded with another ROM");
+        file.close();
+        return false;
+    }
+    if (header.version != expected.version.substr(0, MOVIE_VERSION_SIZE - 1)) {
+        log_warning(filename + " was recorded with " + header.version + ", the replay may diverge");
+    }
+    if (header.flags != expected.flags) {
+        log_warning(filename + " was recorded with another BIOS setting, the keyframes hold the recorded one");
+    }
+    uint64_t state_size;
+    while (get(file, state_size)) {
+        keyframes.push_back(file.tellg());
+        file.seekg(state_size, std::ios::cur);
+        uint32_t count;
+        if (!get(file, count)) break;
+        size_t start = keys.size();
+        keys.resize(start + count);
+        if (!file.read(reinterpret_cast<char*>(keys.data() + start), count * sizeof(halfword))) {
+            keys.resize(start);
+            break;
+        }
+    }
+    file.clear();
+    if (keyframes.empty()) {
+        log_error(filename + " holds no keyframe");
+        file.close();
+        return false;
+    }
+    mode = MOVIE_REPLAY;
+    return true;
+}
+
+// Writes the block being recorded, a movie is only complete once closed
+void Movie::close() {
+    if (mode == MOVIE_RECORD) {
+        write_block();
+        if (!file.good()) log_warning("Unable to write the movie");
+    }
+    if (file.is_open()) file.close();
+    mode        = MOVIE_NONE;
+    block_start = 0;
+    keys.clear();
+    keyframes.clear();
+    pending_keyframe.clear();
+}
+
+void Movie::write_block() {
+    if (pending_keyframe.empty()) return;
+    put(file, uint64_t(pending_keyframe.size()));
+    file.write(reinterpret_cast<const char*>(pending_keyframe.data()), pending_keyframe.size());
+    put(file, uint32_t(keys.size() - block_start));
+    file.write(reinterpret_cast<const char*>(keys.data() + block_start), (keys.size() - block_start) * sizeof(halfword));
+    file.flush();
+    pending_keyframe.clear();
+}
+
+// Starts a new block, the previous one is complete and goes to the file
+void Movie::add_keyframe(const std::vector<byte>& state) {
+    write_block();
+    pending_keyframe = state;
+    block_start      = keys.size();
+}
+
+void Movie::add_frame(halfword keyinput) {
+    keys.push_back(keyinput);
+}
+
+// Loads the last keyframe at or before frame
+bool Movie::load_keyframe(uint64_t frame, std::vector<byte>& state) {
+    if (mode != MOVIE_REPLAY) return false;
+    size_t index = std::min<uint64_t>(frame / header.keyframe_interval, keyframes.size() - 1);
+    uint64_t size;
+    file.seekg(keyframes[index] - std::streamoff(sizeof(size)));
+    if (!get(file, size)) {
+        file.clear();
+        return false;
+    }
+    state.resize(size);
+    bool ok = static_cast<bool>(file.read(reinterpret_cast<char*>(state.data()), size));
+    file.clear();
+    return ok;
+}
@@ -0,0 +1,69 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+static const uint32_t MOVIE_FORMAT              = 4;
+static const uint32_t MOVIE_HLE_BIOS            = 1 << 0;  // header flag, BIOS calls serviced natively
+static const uint32_t DEFAULT_KEYFRAME_INTERVAL = 600;     // frames, about 10 s
+static const int MOVIE_VERSION_SIZE             = 16;
+
+typedef enum {
+    MOVIE_NONE,
+    MOVIE_RECORD,
+    MOVIE_REPLAY
+} MOVIE_MODE;
+
+struct MovieHeader {
+    std::string version;  // emulator version, truncated to MOVIE_VERSION_SIZE - 1 characters
+    uint64_t rom_hash;
+    uint32_t flags;
+    uint32_t keyframe_interval;
+};
+
+// Input movie, the KEYINPUT value of every frame. The file has a header, then one block per keyframe:
+// the savestate at the start of frame k * keyframe_interval, followed by the keys of the frames up to
+// the next keyframe. Seeking loads the last keyframe before the target and replays at most one
+// interval from there. Only the key blocks are read when a movie is opened, keyframes are loaded on
+// demand.
+class Movie {
+    private:
+    MOVIE_MODE mode;
+    std::fstream file;
+    MovieHeader header;
+    std::vector<halfword> keys;             // every frame recorded so far, or the whole movie
+    std::vector<std::streamoff> keyframes;  // file offset of each keyframe, replay only
+    std::vector<byte> pending_keyframe;     // keyframe of the block being recorded
+    size_t block_start;                     // first frame of that block
+
+    void write_block();
+
+    public:
+    Movie();
+    ~Movie();
+    bool record(std::string filename, const MovieHeader& header);
+    bool replay(std::string filename, const MovieHeader& expected);
+    void close();
+    MOVIE_MODE get_mode() {
+        return mode;
+    }
+    uint64_t length() {
+        return keys.size();
+    }
+    bool needs_keyframe(uint64_t frame) {
+        return mode == MOVIE_RECORD && frame % header.keyframe_interval == 0;
+    }
+    void add_keyframe(const std::vector<byte>& state);
+    void add_frame(halfword keyinput);
+    halfword get_keys(uint64_t frame) {
+        return keys[frame];
+    }
+    bool load_keyframe(uint64_t frame, std::vector<byte>& state);
+};
+
+#endif
@@ -0,0 +1,71 @@
+#include "profiler.h"
+
+#include <iomanip>
+#include <iostream>
+
+Profiler profiler;
+
+static const char* section_names[PROFILER_SECTION_COUNT] = {
+    "composite (copy)",
+    "composite (window)",
+    "composite (alpha)",
+    "composite (brightness)",
+    "audio tick",
+    "audio frames dropped",
+    "bios hle call",
+    "idle loops detected",
+    "halts",
+    "idle cycles skipped",
+    "video frame output",
+    "video frames unchanged",
+};
+
+Profiler::Profiler() {
+    reset();
+}
+
+void Profiler::record(PROFILER_SECTION section, uint64_t ns) {
+    total_ns[section].fetch_add(ns, std::memory_order_relaxed);
+    calls[section].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Profiler::count(PROFILER_SECTION section, uint64_t n) {
+    calls[section].fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t Profiler::get_total_ns(PROFILER_SECTION section) {
+    return total_ns[section];
+}
+
+uint64_t Profiler::get_calls(PROFILER_SECTION section) {
+    return calls[section];
+}
+
+void Profiler::reset() {
+    for (int i = 0; i < PROFILER_SECTION_COUNT; i++) {
+        total_ns[i] = 0;
+        calls[i]    = 0;
+    }
+}
+
+void Profiler::report() {
+    for (int i = 0; i < PROFILER_SECTION_COUNT; i++) {
+        uint64_t n  = calls[i];
+        uint64_t ns = total_ns[i];
+        if (n == 0) continue;
+        std::cout << std::left << std::setw(28) << section_names[i] << std::right << std::setw(12) << n;
+        if (ns != 0) {
+            std::cout << std::setw(12) << ns / n << " ns/call" << std::setw(12) << ns / 1000000 << " ms total";
+        }
+        std::cout << "\n";
+    }
+}
+
+ScopedTimer::ScopedTimer(PROFILER_SECTION _section)
+    : section(_section), start(std::chrono::steady_clock::now()) {
+}
+
+ScopedTimer::~ScopedTimer() {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    profiler.record(section, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
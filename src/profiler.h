@@ -0,0 +1,52 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+typedef enum {
+    COMPOSITE_COPY,        // no effect, no window
+    COMPOSITE_WINDOW,      // windows only
+    COMPOSITE_ALPHA,       // alpha blending (BLDCNT mode 1 or semi-transparent OBJs)
+    COMPOSITE_BRIGHTNESS,  // brightness increase/decrease
+    AUDIO_MIX,             // sound generation, mixing and resampling of one tick
+    AUDIO_DROPPED,         // output frames dropped because the ring buffer was full
+    BIOS_HLE,              // BIOS calls serviced natively
+    IDLE_LOOP,             // idle loops detected
+    IDLE_HALT,             // halts, from SWI 2 or HALTCNT
+    IDLE_SKIPPED,          // cycles fast-forwarded while idle
+    FRAME_OUTPUT,          // frame handed to the video output, on the rendering thread
+    FRAME_UNCHANGED,       // video output frames left out because they did not change
+    PROFILER_SECTION_COUNT
+} PROFILER_SECTION;
+
+class Profiler {
+    private:
+    std::atomic<uint64_t> total_ns[PROFILER_SECTION_COUNT];
+    std::atomic<uint64_t> calls[PROFILER_SECTION_COUNT];
+
+    public:
+    Profiler();
+    void record(PROFILER_SECTION section, uint64_t ns);
+    void count(PROFILER_SECTION section, uint64_t n = 1);
+    uint64_t get_total_ns(PROFILER_SECTION section);
+    uint64_t get_calls(PROFILER_SECTION section);
+    void reset();
+    void report();
+};
+
+extern Profiler profiler;
+
+// Adds the lifetime of the object to a profiler section
+class ScopedTimer {
+    private:
+    PROFILER_SECTION section;
+    std::chrono::steady_clock::time_point start;
+
+    public:
+    ScopedTimer(PROFILER_SECTION section);
+    ~ScopedTimer();
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include "render_thread.h"
+
+#include <algorithm>
+
+static_assert(VIDEO_BLOCK_COUNT < 2048, "the delta queue must hold the whole video memory");
+
+RenderThread::RenderThread(Memory& _mem)
+    : mem(_mem), display(_mem), running(false), frame_sink(nullptr) {
+    size_t available;
+    io_ram = mem.get_pointer(IO_RAM_START, available);
+    std::fill(io_shadow, io_shadow + 0x400, 0);
+    std::fill(video_shadow, video_shadow + VIDEO_MEMORY_SIZE, 0);
+    display.set_sources(io_shadow, video_shadow, video_shadow + 0x400, video_shadow + 0x18400);
+    dirty_blocks.reserve(VIDEO_BLOCK_COUNT);
+}
+
+RenderThread::~RenderThread() {
+    stop();
+}
+
+void RenderThread::start() {
+    if (running) return;
+    running = true;
+    thread  = std::thread(&RenderThread::loop, this);
+}
+
+// Renders every submitted scanline then joins the worker
+void RenderThread::stop() {
+    if (!running) return;
+    running.store(false, std::memory_order_release);
+    thread.join();
+}
+
+// Set before start()
+void RenderThread::set_frame_sink(FrameSink* sink) {
+    frame_sink = sink;
+}
+
+void RenderThread::submit_scanline(int line, uint64_t frame) {
+    dirty_blocks.clear();
+    mem.take_video_dirty(dirty_blocks);
+    for (int block : dirty_blocks) {
+        VideoDelta delta;
+        delta.block     = block;
+        const byte* src = mem.get_video_block(block);
+        std::copy(src, src + VIDEO_BLOCK_SIZE, delta.data);
+        while (!deltas.push(delta)) {
+            std::this_thread::yield();
+        }
+    }
+    ScanlineSnapshot snapshot;
+    snapshot.line        = line;
+    snapshot.frame       = frame;
+    snapshot.delta_count = dirty_blocks.size();
+    std::copy(io_ram, io_ram + RENDER_IO_SIZE, snapshot.io_ram);
+    while (!scanlines.push(snapshot)) {
+        std::this_thread::yield();
+    }
+}
+
+void RenderThread::loop() {
+    ScanlineSnapshot snapshot;
+    VideoDelta delta;
+    while (true) {
+        if (!scanlines.pop(snapshot)) {
+            if (!running.load(std::memory_order_acquire) && scanlines.empty()) break;
+            std::this_thread::yield();
+            continue;
+        }
+        for (int i = 0; i < snapshot.delta_count; i++) {
+            while (!deltas.pop(delta)) {
+                std::this_thread::yield();
+            }
+            std::copy(delta.data, delta.data + VIDEO_BLOCK_SIZE, video_shadow + delta.block * VIDEO_BLOCK_SIZE);
+        }
+        std::copy(snapshot.io_ram, snapshot.io_ram + RENDER_IO_SIZE, io_shadow);
+        display.render_scanline(snapshot.line);
+        if (snapshot.line == SCREEN_HEIGHT - 1 && frame_sink) {
+            frame_sink->submit(display.get_framebuffer(), snapshot.frame);
+        }
+    }
+}
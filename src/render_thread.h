@@ -0,0 +1,58 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "display.h"
+#include "frame_sink.h"
+#include "memory.h"
+#include "spsc_queue.h"
+#include "utils.h"
+
+// IO registers read by the renderer, DISPCNT up to BLDY
+static const int RENDER_IO_SIZE = 0x58;
+
+struct ScanlineSnapshot {
+    int line;
+    uint64_t frame;  // emulator frame the scanline belongs to
+    int delta_count;  // VideoDelta entries queued just before this snapshot
+    byte io_ram[RENDER_IO_SIZE];
+};
+
+struct VideoDelta {
+    int block;
+    byte data[VIDEO_BLOCK_SIZE];
+};
+
+// Renders scanlines on a worker thread. The emulation thread records, at the time the scanline
+// would have been rendered, the renderer IO registers and the video memory blocks written since the
+// previous scanline. The worker applies them to its own copy of the video memory before rendering,
+// so the output is the same as rendering on the emulation thread.
+class RenderThread {
+    private:
+    Memory& mem;
+    const byte* io_ram;
+    Display display;
+    byte io_shadow[0x400];
+    byte video_shadow[VIDEO_MEMORY_SIZE];
+    // a scanline never queues more than VIDEO_BLOCK_COUNT deltas, so the producer can always make progress
+    SPSCQueue<ScanlineSnapshot, 512> scanlines;
+    SPSCQueue<VideoDelta, 2048> deltas;
+    std::vector<int> dirty_blocks;
+    std::thread thread;
+    std::atomic<bool> running;
+    FrameSink* frame_sink;  // receives each frame once its last scanline is rendered
+    void loop();
+
+    public:
+    RenderThread(Memory& mem);
+    ~RenderThread();
+    void start();
+    void stop();
+    void set_frame_sink(FrameSink* sink);
+    void submit_scanline(int line, uint64_t frame);
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "utils.h"
+
+// Serialized emulator state. Each stateful class lists its members once in a sync_state() method,
+// which stores them when saving and reads them back when loading, so both directions can not drift
+// apart. Values are copied one at a time, struct padding never ends up in the buffer and the same
+// state always gives the same bytes.
+class Savestate {
+    private:
+    std::vector<byte> data;
+    size_t position;
+    bool loading;
+    bool overrun;
+
+    public:
+    Savestate()
+        : position(0), loading(false), overrun(false) {
+    }
+    explicit Savestate(std::vector<byte> _data)
+        : data(std::move(_data)), position(0), loading(true), overrun(false) {
+    }
+    bool is_loading() {
+        return loading;
+    }
+    // false if a load read past the end of the state or left some of it unread
+    bool good() {
+        return !overrun && (!loading || position == data.size());
+    }
+    const std::vector<byte>& get_data() {
+        return data;
+    }
+    void sync_bytes(void* bytes, size_t size) {
+        if (!loading) {
+            const byte* p = static_cast<const byte*>(bytes);
+            data.insert(data.end(), p, p + size);
+        } else if (position + size <= data.size()) {
+            std::memcpy(bytes, data.data() + position, size);
+            position += size;
+        } else {
+            overrun = true;
+        }
+    }
+    template <typename T>
+    void sync(T& value) {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "structs are synced member by member");
+        sync_bytes(&value, sizeof(T));
+    }
+};
+
+#endif
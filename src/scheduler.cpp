@@ -0,0 +1,60 @@
+#include "scheduler.h"
+
+static const uint64_t NEVER = UINT64_MAX;
+
+Scheduler::Scheduler() {
+    cycles = 0;
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        when[i] = NEVER;
+    }
+    next = NEVER;
+}
+
+void Scheduler::update_next() {
+    next = NEVER;
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        if (when[i] < next) next = when[i];
+    }
+}
+
+void Scheduler::schedule(EVENT event, uint64_t delay) {
+    schedule_at(event, cycles + delay);
+}
+
+void Scheduler::schedule_at(EVENT event, uint64_t time) {
+    when[event] = time;
+    update_next();
+}
+
+void Scheduler::cancel(EVENT event) {
+    when[event] = NEVER;
+    update_next();
+}
+
+bool Scheduler::is_scheduled(EVENT event) {
+    return when[event] != NEVER;
+}
+
+// Removes the earliest event that is due, events scheduled for the same cycle are popped in EVENT order.
+// time is set to the cycle the event was scheduled for, so periodic events can be rescheduled without drift
+bool Scheduler::pop(EVENT& event, uint64_t& time) {
+    if (next > cycles) return false;
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        if (when[i] == next) {
+            event   = static_cast<EVENT>(i);
+            time    = next;
+            when[i] = NEVER;
+            update_next();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scheduler::sync_state(Savestate& state) {
+    state.sync(cycles);
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        state.sync(when[i]);
+    }
+    if (state.is_loading()) update_next();
+}
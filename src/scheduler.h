@@ -0,0 +1,54 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+
+#include "savestate.h"
+
+// Master clock frequency, in cycles per second
+static const uint64_t CPU_FREQUENCY = 16777216;
+
+typedef enum {
+    EVENT_HBLANK,        // end of HDraw
+    EVENT_HDRAW,         // end of HBlank, start of the next scanline
+    EVENT_AUDIO,         // sound generation tick
+    EVENT_TIMER0,        // timer overflows, EVENT_TIMER0 + timer
+    EVENT_TIMER1,
+    EVENT_TIMER2,
+    EVENT_TIMER3,
+    EVENT_BACKUP_FLUSH,  // periodic write back of the save file
+    EVENT_LINK_SYNC,     // link cable synchronization, before the serial messages of the same cycle
+    EVENT_SERIAL,        // serial message taking effect or transfer completion
+    EVENT_IRQ,           // an interrupt is pending, scheduled at the current cycle to end the CPU batch
+    EVENT_COUNT
+} EVENT;
+
+// Keeps the master cycle counter and the time of the next occurrence of each event. There are few
+// event types, each pending at most once, so a flat array beats a priority queue here.
+class Scheduler {
+    private:
+    uint64_t cycles;
+    uint64_t next;
+    uint64_t when[EVENT_COUNT];
+    void update_next();
+
+    public:
+    Scheduler();
+    uint64_t now() {
+        return cycles;
+    }
+    void advance(uint64_t n) {
+        cycles += n;
+    }
+    uint64_t next_event() {
+        return next;
+    }
+    void schedule(EVENT event, uint64_t delay);
+    void schedule_at(EVENT event, uint64_t time);
+    void cancel(EVENT event);
+    bool is_scheduled(EVENT event);
+    bool pop(EVENT& event, uint64_t& time);
+    void sync_state(Savestate& state);
+};
+
+#endif
@@ -0,0 +1,203 @@
+#include "serial.h"
+
+#include <algorithm>
+#include <thread>
+
+Serial::Serial(Memory& _mem, Scheduler& _scheduler, InterruptController& _interrupts)
+    : mem(_mem), scheduler(_scheduler), interrupts(_interrupts), cable(nullptr), id(0), active(false), transfer_end(0) {
+    std::fill(received, received + LINK_MAX_UNITS, ~word(0));
+    mem.set_io_handler(SIOCNT, io_written, this);
+}
+
+// Unit 0 is the multiplayer parent, SI tells the children apart and SD that the cable is connected
+void Serial::connect(LinkCable* _cable, int _id) {
+    cable         = _cable;
+    id            = _id;
+    halfword& cnt = mem.io_halfword(SIOCNT);
+    cnt           = (cnt & ~SIO_SI) | SIO_SD | (id > 0 ? SIO_SI : 0);
+    scheduler.schedule(EVENT_LINK_SYNC, 0);
+}
+
+// The other units stop waiting for this one, and drop what they would send to it
+void Serial::disconnect() {
+    if (cable == nullptr) return;
+    cable->publish(id, LINK_DISCONNECTED);
+    cable = nullptr;
+    scheduler.cancel(EVENT_LINK_SYNC);
+}
+
+SIO_MODE Serial::mode() {
+    if (mem.io_halfword(RCNT) & 0x8000) return SIO_OTHER;
+    switch ((mem.io_halfword(SIOCNT) >> 12) & 0x3) {
+        case 0:
+            return SIO_NORMAL_8;
+        case 1:
+            return SIO_NORMAL_32;
+        case 2:
+            return SIO_MULTIPLAYER;
+        default:
+            return SIO_OTHER;
+    }
+}
+
+// https://problemkaputt.de/gbatek.htm#siomultiplayermode
+// Multiplayer units send a start bit, 16 data bits and a stop bit each, normal transfers run at 256 KHz
+// or 2 MHz
+uint64_t Serial::duration() {
+    static const uint64_t baud_rates[] = {9600, 38400, 57600, 115200};
+    halfword cnt                       = mem.io_halfword(SIOCNT);
+    switch (mode()) {
+        case SIO_MULTIPLAYER:
+            return (cable ? cable->get_units() : 1) * 18 * CPU_FREQUENCY / baud_rates[cnt & 0x3];
+        case SIO_NORMAL_32:
+            return 32 * (cnt & SIO_FAST_CLOCK ? 8 : 64);
+        default:
+            return 8 * (cnt & SIO_FAST_CLOCK ? 8 : 64);
+    }
+}
+
+// SI, SD, the ID and the error flag are read-only in multiplayer mode, where only the parent can start
+// a transfer. In normal mode, the unit with the internal clock starts it.
+void Serial::io_written(void* owner, int, halfword old_value, halfword) {
+    Serial* self  = static_cast<Serial*>(owner);
+    halfword& cnt = self->mem.io_halfword(SIOCNT);
+    SIO_MODE mode = self->mode();
+    if (mode == SIO_MULTIPLAYER) {
+        cnt = (cnt & ~0x7C) | (old_value & 0x7C);
+        if (self->id > 0) cnt = (cnt & ~SIO_START) | (old_value & SIO_START);
+    } else if (mode != SIO_OTHER) {
+        cnt = (cnt & ~SIO_SI) | (old_value & SIO_SI);
+    }
+    bool started = (cnt & SIO_START) && !(old_value & SIO_START);
+    if (!started || self->active) return;
+    if (mode == SIO_MULTIPLAYER || ((mode == SIO_NORMAL_8 || mode == SIO_NORMAL_32) && (cnt & SIO_INTERNAL_CLOCK))) {
+        self->start(self->scheduler.now());
+    }
+}
+
+void Serial::start(uint64_t time) {
+    active       = true;
+    transfer_end = time + duration();
+    std::fill(received, received + LINK_MAX_UNITS, ~word(0));
+    if (cable) transfer_end = std::max(transfer_end, time + 2 * cable->get_lookahead());
+    if (mode() == SIO_MULTIPLAYER) {
+        received[id] = mem.io_halfword(SIOMLT_SEND);
+        for (int unit = 0; cable && unit < cable->get_units(); unit++) {
+            if (unit != id) send(unit, LINK_START, time + cable->get_lookahead(), received[id]);
+        }
+    } else if (cable && (id ^ 1) < cable->get_units()) {
+        word value = mode() == SIO_NORMAL_32 ? mem.io_word(SIODATA32) : mem.io_halfword(SIODATA8) & 0xFF;
+        send(id ^ 1, LINK_START, time + cable->get_lookahead(), value);
+    }
+    schedule_update();
+}
+
+void Serial::send(int to, LINK_MESSAGE type, uint64_t time, word value) {
+    cable->send(id, to, LinkMessage{type, id, time, transfer_end, value});
+}
+
+// Children join the multiplayer transfer of the parent and send their data to every unit. A normal
+// mode slave always shifts its data out, but only receives when its start bit is set.
+void Serial::apply(const LinkMessage& message) {
+    SIO_MODE mode   = this->mode();
+    halfword& cnt   = mem.io_halfword(SIOCNT);
+    uint64_t answer = message.time + (cable ? cable->get_lookahead() : 0);
+    if (message.type == LINK_START && cable) {
+        if (mode == SIO_MULTIPLAYER && id > 0) {
+            active       = true;
+            transfer_end = message.end;
+            std::fill(received, received + LINK_MAX_UNITS, ~word(0));
+            received[message.sender] = message.value;
+            received[id]             = mem.io_halfword(SIOMLT_SEND);
+            cnt |= SIO_START;  // busy
+            for (int unit = 0; unit < cable->get_units(); unit++) {
+                if (unit != id) send(unit, LINK_DATA, answer, received[id]);
+            }
+        } else if ((mode == SIO_NORMAL_8 || mode == SIO_NORMAL_32) && !(cnt & SIO_INTERNAL_CLOCK)) {
+            word value = mode == SIO_NORMAL_32 ? mem.io_word(SIODATA32) : mem.io_halfword(SIODATA8) & 0xFF;
+            send(message.sender, LINK_DATA, answer, value);
+            if (cnt & SIO_START) {
+                active       = true;
+                transfer_end = message.end;
+                received[0]  = message.value;
+            }
+        }
+    } else if (message.type == LINK_DATA && active) {
+        received[mode == SIO_MULTIPLAYER ? message.sender : 0] = message.value;
+    }
+}
+
+void Serial::complete() {
+    halfword& cnt = mem.io_halfword(SIOCNT);
+    switch (mode()) {
+        case SIO_MULTIPLAYER:
+            for (int unit = 0; unit < LINK_MAX_UNITS; unit++) {
+                mem.io_halfword(SIOMULTI0 + unit * 2) = received[unit];
+            }
+            cnt = (cnt & ~0x30) | (id << 4);
+            break;
+        case SIO_NORMAL_32:
+            mem.io_word(SIODATA32) = received[0];
+            break;
+        default:
+            mem.io_halfword(SIODATA8) = (mem.io_halfword(SIODATA8) & 0xFF00) | (received[0] & 0xFF);
+            break;
+    }
+    active = false;
+    cnt &= ~SIO_START;
+    if (cnt & SIO_IRQ) interrupts.request(IRQ_SERIAL);
+}
+
+void Serial::schedule_update() {
+    uint64_t next = active ? transfer_end : LINK_DISCONNECTED;
+    if (!pending.empty()) next = std::min(next, pending.front().time);
+    if (next == LINK_DISCONNECTED) {
+        scheduler.cancel(EVENT_SERIAL);
+    } else {
+        scheduler.schedule_at(EVENT_SERIAL, next);
+    }
+}
+
+// EVENT_LINK_SYNC: publishes the cycle reached and picks up the messages of the other units, waiting
+// while the slowest of them is a whole lookahead behind. Runs at least twice per lookahead so the
+// other units can make progress.
+void Serial::sync(uint64_t time) {
+    if (cable == nullptr) return;
+    cable->publish(id, time);
+    size_t queued = pending.size();
+    uint64_t horizon;
+    while (true) {
+        horizon = cable->horizon(id);
+        cable->receive(id, pending);
+        if (horizon > time) break;
+        std::this_thread::yield();
+    }
+    if (pending.size() != queued) {
+        std::stable_sort(pending.begin(), pending.end(), [](const LinkMessage& a, const LinkMessage& b) {
+            return a.time != b.time ? a.time < b.time : a.sender < b.sender;
+        });
+        schedule_update();
+    }
+    // at least a cycle later, a lookahead of 1 would otherwise sync on the same cycle forever
+    scheduler.schedule_at(EVENT_LINK_SYNC, std::min(horizon, time + std::max<uint64_t>(1, cable->get_lookahead() / 2)));
+}
+
+// EVENT_SERIAL: messages take effect in cycle then sender order, before a transfer ending on the same cycle
+void Serial::update(uint64_t time) {
+    size_t due = 0;
+    while (due < pending.size() && pending[due].time <= time) {
+        apply(pending[due++]);
+    }
+    pending.erase(pending.begin(), pending.begin() + due);
+    if (active && transfer_end <= time) complete();
+    schedule_update();
+}
+
+// Messages in flight belong to the link, they are not part of the state
+void Serial::sync_state(Savestate& state) {
+    state.sync(active);
+    state.sync(transfer_end);
+    for (int unit = 0; unit < LINK_MAX_UNITS; unit++) {
+        state.sync(received[unit]);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+// https://problemkaputt.de/gbatek.htm#gbacommunicationports
+#include <cstdint>
+#include <vector>
+
+#include "interrupts.h"
+#include "link.h"
+#include "memory.h"
+#include "savestate.h"
+#include "scheduler.h"
+#include "utils.h"
+
+// IO register offsets, relative to IO_RAM_START
+static const int SIODATA32   = 0x120;
+static const int SIOMULTI0   = 0x120;  // SIOMULTI0-3, one halfword per unit
+static const int SIOCNT      = 0x128;
+static const int SIOMLT_SEND = 0x12A;
+static const int SIODATA8    = 0x12A;
+static const int RCNT        = 0x134;
+
+// SIOCNT bits
+static const halfword SIO_INTERNAL_CLOCK = 0x0001;  // normal mode
+static const halfword SIO_FAST_CLOCK     = 0x0002;  // normal mode, 2 MHz instead of 256 KHz
+static const halfword SIO_SI             = 0x0004;  // multiplayer: 0 for the parent
+static const halfword SIO_SD             = 0x0008;  // multiplayer: every unit is connected
+static const halfword SIO_START          = 0x0080;
+static const halfword SIO_IRQ            = 0x4000;
+
+typedef enum {
+    SIO_NORMAL_8,
+    SIO_NORMAL_32,
+    SIO_MULTIPLAYER,
+    SIO_OTHER  // UART, general purpose and JOY BUS, no transfer
+} SIO_MODE;
+
+// Serial port, connected to the other units of a LinkCable or to nothing. Multiplayer transfers are
+// started by the parent (unit 0) and exchange SIOMLT_SEND between every unit, normal transfers are
+// started by the unit with the internal clock and swap SIODATA with its peer (units 0 and 1, 2 and 3).
+// On a cable a transfer lasts at least two lookaheads: the start reaches the other units after one,
+// their data comes back after the second. Units missing from the transfer read as all ones.
+class Serial {
+    private:
+    Memory& mem;
+    Scheduler& scheduler;
+    InterruptController& interrupts;
+    LinkCable* cable;
+    int id;
+    bool active;  // transfer in progress
+    uint64_t transfer_end;
+    word received[LINK_MAX_UNITS];  // multiplayer data of each unit, normal mode data of the peer in [0]
+    std::vector<LinkMessage> pending;  // received messages waiting for their cycle, in order
+
+    static void io_written(void* owner, int offset, halfword old_value, halfword mask);
+    SIO_MODE mode();
+    uint64_t duration();
+    void start(uint64_t time);
+    void apply(const LinkMessage& message);
+    void complete();
+    void send(int to, LINK_MESSAGE type, uint64_t time, word value);
+    void schedule_update();
+
+    public:
+    Serial(Memory& mem, Scheduler& scheduler, InterruptController& interrupts);
+    void connect(LinkCable* cable, int id);
+    void disconnect();
+    void sync(uint64_t time);
+    void update(uint64_t time);
+    void sync_state(Savestate& state);
+};
+
+#endif
@@ -0,0 +1,420 @@
+#include "soundsystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "profiler.h"
+
+static const int duty_steps[4]       = {1, 2, 4, 6};  // high steps out of 8
+static const int wave_volume[4]      = {0, 4, 2, 1};  // in quarters
+static const uint32_t RESAMPLE_STEP  = (uint64_t(SAMPLE_RATE) << 16) / OUTPUT_RATE;
+static const halfword LENGTH_ENABLE  = 0x4000;
+static const halfword RESTART        = 0x8000;
+
+// Phase step of a period lasting two samples. Point sampling anything faster would alias it to an
+// arbitrary level, such channels play the average level of their period instead.
+static const uint64_t NYQUIST_STEP = uint64_t(1) << 31;
+
+SoundSystem::SoundSystem(Memory& _mem, Scheduler& _scheduler)
+    : mem(_mem), scheduler(_scheduler) {
+    for (int c = 0; c < 2; c++) {
+        square[c] = SquareChannel();
+        fifo[c].read        = 0;
+        fifo[c].count       = 0;
+        fifo[c].sample      = 0;
+        fifo[c].tick_sample = 0;
+        fifo[c].changes.reserve(256);
+    }
+    wave              = WaveChannel();
+    noise             = NoiseChannel();
+    noise.lfsr        = 0x7FFF;
+    sequencer_step    = 0;
+    last_tick         = 0;
+    resample_position = 0;
+    last_left         = 0;
+    last_right        = 0;
+    output_enabled    = false;
+    output_blocking   = false;
+    const int handled[] = {SOUND1CNT_X, SOUND2CNT_H, SOUND3CNT_X, SOUND4CNT_H, SOUNDCNT_H, FIFO_A + 2, FIFO_B + 2};
+    for (int offset : handled) {
+        mem.set_io_handler(offset, io_written, this);
+    }
+}
+
+// The mixing buffers are refilled on every tick and the output ring is not emulated state, both are left out
+void SoundSystem::sync_state(Savestate& state) {
+    for (SquareChannel& ch : square) {
+        state.sync(ch.enabled);
+        state.sync(ch.phase);
+        state.sync(ch.volume);
+        state.sync(ch.envelope_timer);
+        state.sync(ch.sweep_timer);
+        state.sync(ch.length);
+    }
+    state.sync(wave.enabled);
+    state.sync(wave.phase);
+    state.sync(wave.length);
+    state.sync(noise.enabled);
+    state.sync(noise.clock);
+    state.sync(noise.lfsr);
+    state.sync(noise.volume);
+    state.sync(noise.envelope_timer);
+    state.sync(noise.length);
+    for (FifoChannel& f : fifo) {
+        state.sync_bytes(f.buffer, sizeof(f.buffer));
+        state.sync(f.read);
+        state.sync(f.count);
+        state.sync(f.sample);
+        state.sync(f.tick_sample);
+        uint32_t changes = f.changes.size();
+        state.sync(changes);
+        if (state.is_loading()) f.changes.resize(changes);
+        for (auto& change : f.changes) {
+            state.sync(change.first);
+            state.sync(change.second);
+        }
+    }
+    state.sync(sequencer_step);
+    state.sync(last_tick);
+    state.sync(resample_position);
+    state.sync(last_left);
+    state.sync(last_right);
+}
+
+// A blocking output waits for the consumer when the ring is full, for consumers without a real-time
+// deadline such as a file
+void SoundSystem::set_output_enabled(bool enabled, bool blocking) {
+    output_enabled  = enabled;
+    output_blocking = blocking;
+}
+
+AudioRing& SoundSystem::get_output() {
+    return output;
+}
+
+// Generates the samples since the previous tick, then clocks the 512 Hz frame sequencer
+void SoundSystem::tick(uint64_t time) {
+    ScopedTimer timer(AUDIO_MIX);
+    generate_square(0, channel_samples[0]);
+    generate_square(1, channel_samples[1]);
+    generate_wave(channel_samples[2]);
+    generate_noise(channel_samples[3]);
+    generate_fifo(0, fifo_samples[0]);
+    generate_fifo(1, fifo_samples[1]);
+    mix();
+    resample();
+    step_sequencer();
+    last_tick = time;
+}
+
+// Restart and FIFO reset bits are write-only, they act as soon as they are written. A FIFO takes the
+// 4 samples of a word once its upper halfword is written.
+void SoundSystem::io_written(void* owner, int offset, halfword, halfword) {
+    SoundSystem* sound = static_cast<SoundSystem*>(owner);
+    halfword& reg      = sound->mem.io_halfword(offset);
+    switch (offset) {
+        case SOUND1CNT_X:
+        case SOUND2CNT_H:
+            if (reg & RESTART) sound->restart_square(offset == SOUND1CNT_X ? 0 : 1);
+            reg &= ~RESTART;
+            break;
+        case SOUND3CNT_X:
+            if (reg & RESTART) sound->restart_wave();
+            reg &= ~RESTART;
+            break;
+        case SOUND4CNT_H:
+            if (reg & RESTART) sound->restart_noise();
+            reg &= ~RESTART;
+            break;
+        case SOUNDCNT_H:
+            if (reg & 0x0800) sound->fifo_reset(0);
+            if (reg & 0x8000) sound->fifo_reset(1);
+            reg &= ~0x8800;
+            break;
+        case FIFO_A + 2:
+            sound->fifo_write(0, sound->mem.io_word(FIFO_A));
+            break;
+        case FIFO_B + 2:
+            sound->fifo_write(1, sound->mem.io_word(FIFO_B));
+            break;
+    }
+}
+
+void SoundSystem::restart_square(int channel) {
+    SquareChannel& ch = square[channel];
+    halfword cnt      = mem.io_halfword(channel == 0 ? SOUND1CNT_H : SOUND2CNT_L);
+    ch.enabled        = cnt & 0xF800;  // the DAC is off with a zero volume decreasing envelope
+    ch.phase          = 0;
+    ch.volume         = cnt >> 12;
+    ch.envelope_timer = (cnt >> 8) & 0x7;
+    ch.sweep_timer    = (mem.io_halfword(SOUND1CNT_L) >> 4) & 0x7;
+    ch.length         = 64 - (cnt & 0x3F);
+}
+
+void SoundSystem::restart_wave() {
+    wave.enabled = mem.io_halfword(SOUND3CNT_L) & 0x80;
+    wave.phase   = 0;
+    wave.length  = 256 - (mem.io_halfword(SOUND3CNT_H) & 0xFF);
+}
+
+void SoundSystem::restart_noise() {
+    halfword cnt         = mem.io_halfword(SOUND4CNT_L);
+    noise.enabled        = cnt & 0xF800;
+    noise.clock          = 0;
+    noise.lfsr           = (mem.io_halfword(SOUND4CNT_H) & 0x8) ? 0x7F : 0x7FFF;
+    noise.volume         = cnt >> 12;
+    noise.envelope_timer = (cnt >> 8) & 0x7;
+    noise.length         = 64 - (cnt & 0x3F);
+}
+
+// Sample i of a batch only depends on the phase at the start of the batch, so the loop vectorizes
+void SoundSystem::generate_square(int channel, int32_t* out) {
+    SquareChannel& ch = square[channel];
+    if (!ch.enabled) {
+        std::fill(out, out + AUDIO_BATCH, 0);
+        return;
+    }
+    halfword cnt    = mem.io_halfword(channel == 0 ? SOUND1CNT_H : SOUND2CNT_L);
+    int frequency   = mem.io_halfword(channel == 0 ? SOUND1CNT_X : SOUND2CNT_H) & 0x7FF;
+    uint64_t rate   = (uint64_t(4) << 32) / (2048 - frequency);
+    uint32_t high   = duty_steps[(cnt >> 6) & 0x3];
+    int32_t volume  = ch.volume;
+    uint32_t phase  = ch.phase;
+    if (rate >= NYQUIST_STEP) {
+        // frequencies 2040 and up, the step does not even fit 32 bits from 2045
+        std::fill(out, out + AUDIO_BATCH, volume * (2 * int32_t(high) - 8) / 8);
+        return;
+    }
+    uint32_t step = rate;
+    for (int i = 0; i < AUDIO_BATCH; i++) {
+        uint32_t p = phase + i * step;
+        out[i]     = (p >> 29) < high ? volume : -volume;
+    }
+    ch.phase = phase + AUDIO_BATCH * step;
+}
+
+void SoundSystem::generate_wave(int32_t* out) {
+    halfword cnt_h = mem.io_halfword(SOUND3CNT_H);
+    if (!wave.enabled || !(mem.io_halfword(SOUND3CNT_L) & 0x80)) {
+        std::fill(out, out + AUDIO_BATCH, 0);
+        return;
+    }
+    // only the 32 samples visible in WAVE_RAM are played, two bank mode is not implemented yet
+    const byte* samples = reinterpret_cast<const byte*>(&mem.io_halfword(WAVE_RAM));
+    int rate            = mem.io_halfword(SOUND3CNT_X) & 0x7FF;
+    uint64_t table_rate = (uint64_t(2) << 32) / (2048 - rate);
+    int32_t volume      = (cnt_h & 0x8000) ? 3 : wave_volume[(cnt_h >> 13) & 0x3];
+    uint32_t phase      = wave.phase;
+    if (table_rate >= NYQUIST_STEP) {
+        // rates 2044 and up, the step does not even fit 32 bits from 2046
+        int32_t sum = 0;
+        for (int index = 0; index < 32; index++) {
+            int32_t nibble = (samples[index >> 1] >> ((index & 1) ? 0 : 4)) & 0xF;
+            sum += ((nibble * 2 - 15) * volume) >> 2;
+        }
+        std::fill(out, out + AUDIO_BATCH, sum / 32);
+        return;
+    }
+    uint32_t step = table_rate;
+    for (int i = 0; i < AUDIO_BATCH; i++) {
+        uint32_t index = (phase + i * step) >> 27;
+        int32_t nibble = (samples[index >> 1] >> ((index & 1) ? 0 : 4)) & 0xF;
+        out[i]         = ((nibble * 2 - 15) * volume) >> 2;
+    }
+    wave.phase = phase + AUDIO_BATCH * step;
+}
+
+// The LFSR is inherently sequential, this one stays scalar
+void SoundSystem::generate_noise(int32_t* out) {
+    if (!noise.enabled) {
+        std::fill(out, out + AUDIO_BATCH, 0);
+        return;
+    }
+    halfword cnt    = mem.io_halfword(SOUND4CNT_H);
+    int ratio       = cnt & 0x7;
+    int shift       = (cnt >> 4) & 0xF;
+    bool narrow     = cnt & 0x8;
+    uint32_t rate   = shift >= 14 ? 0 : ((ratio == 0 ? 1048576 : 524288 / ratio) >> (shift + 1)) * 2;
+    int32_t volume  = noise.volume;
+    for (int i = 0; i < AUDIO_BATCH; i++) {
+        noise.clock += rate;
+        while (noise.clock >= 0x10000) {
+            noise.clock -= 0x10000;
+            halfword bit = (noise.lfsr ^ (noise.lfsr >> 1)) & 1;
+            noise.lfsr   = (noise.lfsr >> 1) | (bit << 14);
+            if (narrow) noise.lfsr = (noise.lfsr & ~0x40) | (bit << 6);
+        }
+        out[i] = (noise.lfsr & 1) ? -volume : volume;
+    }
+}
+
+// FIFO samples change at timer overflows, the batch is filled one constant segment at a time
+void SoundSystem::generate_fifo(int channel, int32_t* out) {
+    FifoChannel& f = fifo[channel];
+    int position   = 0;
+    int32_t value  = f.tick_sample;
+    for (auto& change : f.changes) {
+        int64_t index = std::clamp<int64_t>((int64_t(change.first) - int64_t(last_tick)) / SAMPLE_CYCLES, 0, AUDIO_BATCH);
+        if (index > position) {
+            std::fill(out + position, out + index, value);
+            position = index;
+        }
+        value = change.second;
+    }
+    std::fill(out + position, out + AUDIO_BATCH, value);
+    f.changes.clear();
+    f.tick_sample = f.sample;
+}
+
+// https://problemkaputt.de/gbatek.htm#gbasoundcontrolregisters
+void SoundSystem::mix() {
+    halfword cnt_l = mem.io_halfword(SOUNDCNT_L);
+    halfword cnt_h = mem.io_halfword(SOUNDCNT_H);
+    int32_t* left  = mixed[0];
+    int32_t* right = mixed[1];
+    left[0]        = last_left;
+    right[0]       = last_right;
+    if (!(mem.io_halfword(SOUNDCNT_X) & 0x80)) {
+        std::fill(left + 1, left + AUDIO_BATCH + 1, 0);
+        std::fill(right + 1, right + AUDIO_BATCH + 1, 0);
+    } else {
+        int psg_shift  = 2 - std::min(cnt_h & 0x3, 2);
+        int32_t vol_r  = (cnt_l & 0x7) + 1;
+        int32_t vol_l  = ((cnt_l >> 4) & 0x7) + 1;
+        int32_t mul_a  = (cnt_h & 0x4) ? 4 : 2;
+        int32_t mul_b  = (cnt_h & 0x8) ? 4 : 2;
+        int32_t a_r    = ((cnt_h >> 8) & 1) * mul_a;
+        int32_t a_l    = ((cnt_h >> 9) & 1) * mul_a;
+        int32_t b_r    = ((cnt_h >> 12) & 1) * mul_b;
+        int32_t b_l    = ((cnt_h >> 13) & 1) * mul_b;
+        int32_t en_r[4], en_l[4];
+        for (int c = 0; c < 4; c++) {
+            en_r[c] = (cnt_l >> (8 + c)) & 1;
+            en_l[c] = (cnt_l >> (12 + c)) & 1;
+        }
+        for (int i = 0; i < AUDIO_BATCH; i++) {
+            int32_t c0 = channel_samples[0][i], c1 = channel_samples[1][i];
+            int32_t c2 = channel_samples[2][i], c3 = channel_samples[3][i];
+            int32_t r  = ((c0 * en_r[0] + c1 * en_r[1] + c2 * en_r[2] + c3 * en_r[3]) * vol_r) >> psg_shift;
+            int32_t l  = ((c0 * en_l[0] + c1 * en_l[1] + c2 * en_l[2] + c3 * en_l[3]) * vol_l) >> psg_shift;
+            r += fifo_samples[0][i] * a_r + fifo_samples[1][i] * b_r;
+            l += fifo_samples[0][i] * a_l + fifo_samples[1][i] * b_l;
+            right[i + 1] = std::clamp(r * 16, -32767, 32767);
+            left[i + 1]  = std::clamp(l * 16, -32767, 32767);
+        }
+    }
+    last_left  = left[AUDIO_BATCH];
+    last_right = right[AUDIO_BATCH];
+}
+
+// Linear interpolation from SAMPLE_RATE to OUTPUT_RATE. The output is only produced while a consumer
+// is attached. A full ring drops frames instead of waiting, unless the output is blocking.
+void SoundSystem::resample() {
+    static const uint32_t end = AUDIO_BATCH << 16;
+    AudioFrame frames[AUDIO_BATCH * 2];
+    uint32_t position = resample_position;
+    int n             = position < end ? (end - position + RESAMPLE_STEP - 1) / RESAMPLE_STEP : 0;
+    for (int j = 0; j < n; j++) {
+        uint32_t p      = position + j * RESAMPLE_STEP;
+        uint32_t index  = p >> 16;
+        int32_t frac    = (p & 0xFFFF) >> 1;
+        int32_t l       = mixed[0][index] + (((mixed[0][index + 1] - mixed[0][index]) * frac) >> 15);
+        int32_t r       = mixed[1][index] + (((mixed[1][index + 1] - mixed[1][index]) * frac) >> 15);
+        frames[j].left  = l;
+        frames[j].right = r;
+    }
+    resample_position = position + n * RESAMPLE_STEP - end;
+    if (!output_enabled) return;
+    for (int j = 0; j < n; j++) {
+        while (!output.push(frames[j])) {
+            if (!output_blocking) {
+                profiler.count(AUDIO_DROPPED, n - j);
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+
+// Length counters at 256 Hz, channel 1 sweep at 128 Hz and envelopes at 64 Hz
+void SoundSystem::step_sequencer() {
+    halfword length_flags[4] = {mem.io_halfword(SOUND1CNT_X), mem.io_halfword(SOUND2CNT_H), mem.io_halfword(SOUND3CNT_X), mem.io_halfword(SOUND4CNT_H)};
+    if ((sequencer_step & 1) == 0) {
+        for (int c = 0; c < 2; c++) {
+            if ((length_flags[c] & LENGTH_ENABLE) && square[c].length > 0 && --square[c].length == 0) square[c].enabled = false;
+        }
+        if ((length_flags[2] & LENGTH_ENABLE) && wave.length > 0 && --wave.length == 0) wave.enabled = false;
+        if ((length_flags[3] & LENGTH_ENABLE) && noise.length > 0 && --noise.length == 0) noise.enabled = false;
+    }
+    if (sequencer_step == 2 || sequencer_step == 6) {
+        halfword sweep = mem.io_halfword(SOUND1CNT_L);
+        int time       = (sweep >> 4) & 0x7;
+        if (square[0].enabled && time != 0 && --square[0].sweep_timer <= 0) {
+            square[0].sweep_timer = time;
+            halfword& x           = mem.io_halfword(SOUND1CNT_X);
+            int frequency         = x & 0x7FF;
+            int delta             = frequency >> (sweep & 0x7);
+            int next              = (sweep & 0x8) ? frequency - delta : frequency + delta;
+            if (next > 0x7FF) {
+                square[0].enabled = false;
+            } else if (sweep & 0x7) {
+                // the new rate is written back to the register like on hardware
+                x = (x & ~0x7FF) | next;
+            }
+        }
+    }
+    if (sequencer_step == 7) {
+        halfword envelopes[2] = {mem.io_halfword(SOUND1CNT_H), mem.io_halfword(SOUND2CNT_L)};
+        for (int c = 0; c < 2; c++) {
+            int time = (envelopes[c] >> 8) & 0x7;
+            if (time == 0 || --square[c].envelope_timer > 0) continue;
+            square[c].envelope_timer = time;
+            square[c].volume         = std::clamp(square[c].volume + ((envelopes[c] & 0x800) ? 1 : -1), 0, 15);
+        }
+        halfword envelope = mem.io_halfword(SOUND4CNT_L);
+        int time          = (envelope >> 8) & 0x7;
+        if (time != 0 && --noise.envelope_timer <= 0) {
+            noise.envelope_timer = time;
+            noise.volume         = std::clamp(noise.volume + ((envelope & 0x800) ? 1 : -1), 0, 15);
+        }
+    }
+    sequencer_step = (sequencer_step + 1) & 0x7;
+
+    halfword& cnt_x = mem.io_halfword(SOUNDCNT_X);
+    cnt_x           = (cnt_x & ~0xF) | square[0].enabled | square[1].enabled << 1 | wave.enabled << 2 | noise.enabled << 3;
+}
+
+// https://problemkaputt.de/gbatek.htm#gbasoundchannelaandbdmasound
+void SoundSystem::fifo_write(int channel, word value) {
+    FifoChannel& f = fifo[channel];
+    for (int i = 0; i < 4 && f.count < 32; i++) {
+        f.buffer[(f.read + f.count) & 31] = static_cast<int8_t>(value >> (i * 8));
+        f.count++;
+    }
+}
+
+void SoundSystem::fifo_reset(int channel) {
+    fifo[channel].read  = 0;
+    fifo[channel].count = 0;
+}
+
+int SoundSystem::fifo_size(int channel) {
+    return fifo[channel].count;
+}
+
+// Each FIFO plays the next sample when the timer selected in SOUNDCNT_H overflows
+void SoundSystem::timer_overflow(int timer, uint64_t time) {
+    if (timer > 1) return;
+    halfword cnt_h = mem.io_halfword(SOUNDCNT_H);
+    for (int c = 0; c < 2; c++) {
+        if (((cnt_h >> (10 + c * 4)) & 1) != timer) continue;
+        FifoChannel& f = fifo[c];
+        if (f.count > 0) {
+            f.sample = f.buffer[f.read];
+            f.read   = (f.read + 1) & 31;
+            f.count--;
+        }
+        f.changes.push_back({time, f.sample});
+    }
+}
@@ -1,6 +1,126 @@
 #ifndef SOUND_SYSTEM_H
 #define SOUND_SYSTEM_H
 
-class SoundSystem {};
+// https://problemkaputt.de/gbatek.htm#gbasoundcontroller
+#include <cstdint>
+#include <vector>
 
-#endif
\ No newline at end of file
+#include "memory.h"
+#include "savestate.h"
+#include "scheduler.h"
+#include "spsc_queue.h"
+#include "utils.h"
+
+static const int SAMPLE_RATE       = 32768;  // internal mixing rate
+static const int OUTPUT_RATE       = 48000;
+static const int SAMPLE_CYCLES     = CPU_FREQUENCY / SAMPLE_RATE;
+static const int AUDIO_BATCH       = 64;  // samples generated per tick, one 512 Hz frame sequencer step
+static const int AUDIO_TICK_CYCLES = AUDIO_BATCH * SAMPLE_CYCLES;
+
+// IO register offsets, relative to IO_RAM_START
+static const int SOUND1CNT_L = 0x60;
+static const int SOUND1CNT_H = 0x62;
+static const int SOUND1CNT_X = 0x64;
+static const int SOUND2CNT_L = 0x68;
+static const int SOUND2CNT_H = 0x6C;
+static const int SOUND3CNT_L = 0x70;
+static const int SOUND3CNT_H = 0x72;
+static const int SOUND3CNT_X = 0x74;
+static const int SOUND4CNT_L = 0x78;
+static const int SOUND4CNT_H = 0x7C;
+static const int SOUNDCNT_L  = 0x80;
+static const int SOUNDCNT_H  = 0x82;
+static const int SOUNDCNT_X  = 0x84;
+static const int SOUNDBIAS   = 0x88;
+static const int WAVE_RAM    = 0x90;
+static const int FIFO_A      = 0xA0;
+static const int FIFO_B      = 0xA4;
+
+struct AudioFrame {
+    int16_t left;
+    int16_t right;
+};
+
+// ~340ms of output, when it is full frames are dropped rather than blocking the emulation thread, unless
+// the output is blocking
+typedef SPSCQueue<AudioFrame, 16384> AudioRing;
+
+struct SquareChannel {
+    bool enabled;
+    uint32_t phase;  // a full period is 2^32, the rate is read from SOUNDxCNT_X/SOUND2CNT_H
+    int volume;
+    int envelope_timer;
+    int sweep_timer;
+    int length;
+};
+
+struct WaveChannel {
+    bool enabled;
+    uint32_t phase;
+    int length;
+};
+
+struct NoiseChannel {
+    bool enabled;
+    uint32_t clock;  // 16.16 fixed point LFSR clocks
+    halfword lfsr;
+    int volume;
+    int envelope_timer;
+    int length;
+};
+
+struct FifoChannel {
+    int8_t buffer[32];
+    int read;
+    int count;
+    int8_t sample;
+    int8_t tick_sample;  // sample playing at the start of the current tick
+    std::vector<std::pair<uint64_t, int8_t>> changes;  // samples popped during the current tick
+};
+
+class SoundSystem {
+    private:
+    Memory& mem;
+    Scheduler& scheduler;
+    SquareChannel square[2];
+    WaveChannel wave;
+    NoiseChannel noise;
+    FifoChannel fifo[2];
+    int sequencer_step;
+    uint64_t last_tick;
+    uint32_t resample_position;  // 16.16 fixed point, relative to the last sample of the previous batch
+    int32_t last_left;
+    int32_t last_right;
+    bool output_enabled;
+    bool output_blocking;
+    AudioRing output;
+
+    int32_t channel_samples[4][AUDIO_BATCH];
+    int32_t fifo_samples[2][AUDIO_BATCH];
+    int32_t mixed[2][AUDIO_BATCH + 1];
+
+    static void io_written(void* owner, int offset, halfword old_value, halfword mask);
+    void restart_square(int channel);
+    void restart_wave();
+    void restart_noise();
+    void generate_square(int channel, int32_t* out);
+    void generate_wave(int32_t* out);
+    void generate_noise(int32_t* out);
+    void generate_fifo(int channel, int32_t* out);
+    void mix();
+    void resample();
+    void step_sequencer();
+
+    public:
+    SoundSystem(Memory& mem, Scheduler& scheduler);
+    void tick(uint64_t time);
+    void fifo_write(int channel, word value);
+    void fifo_reset(int channel);
+    int fifo_size(int channel);
+    void timer_overflow(int timer, uint64_t time);
+    void set_output_enabled(bool enabled, bool blocking);
+    void sync_state(Savestate& state);
+    AudioRing& get_output();
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// Lock-free single producer single consumer ring buffer. SIZE must be a power of two, one slot is
+// never used so a full queue can be told apart from an empty one.
+template <typename T, size_t SIZE>
+class SPSCQueue {
+    static_assert((SIZE & (SIZE - 1)) == 0, "SPSCQueue size must be a power of two");
+
+    private:
+    alignas(64) std::atomic<size_t> head;  // next slot to read, owned by the consumer
+    alignas(64) std::atomic<size_t> tail;  // next slot to write, owned by the producer
+    alignas(64) T buffer[SIZE];
+
+    public:
+    SPSCQueue()
+        : head(0), tail(0) {
+    }
+
+    bool push(const T& item) {
+        size_t t    = tail.load(std::memory_order_relaxed);
+        size_t next = (t + 1) & (SIZE - 1);
+        if (next == head.load(std::memory_order_acquire)) return false;
+        buffer[t] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        item = buffer[h];
+        head.store((h + 1) & (SIZE - 1), std::memory_order_release);
+        return true;
+    }
+
+    // Producer side view of the free space, may be lower than the real value
+    size_t free_space() {
+        return (head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed) - 1) & (SIZE - 1);
+    }
+
+    // Consumer side view of the queued items, may be lower than the real value
+    size_t size() {
+        return (tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed)) & (SIZE - 1);
+    }
+
+    bool empty() {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+};
+
+#endif
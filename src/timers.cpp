@@ -0,0 +1,148 @@
+#include "timers.h"
+
+static const int prescaler_shift[4] = {0, 6, 8, 10};  // 1, 64, 256 and 1024 cycles per tick
+
+Timers::Timers(Memory& _mem, Scheduler& _scheduler, SoundSystem& _sound, DMA& _dma, InterruptController& _interrupts)
+    : mem(_mem), scheduler(_scheduler), sound(_sound), dma(_dma), interrupts(_interrupts) {
+    for (int i = 0; i < 4; i++) {
+        timers[i] = Timer();
+        mem.set_io_handler(TM0CNT_L + i * TIMER_STRIDE, io_written, this);
+        mem.set_io_handler(TM0CNT_H + i * TIMER_STRIDE, io_written, this);
+        mem.set_io_read_handler(TM0CNT_L + i * TIMER_STRIDE, io_read, this);
+    }
+}
+
+halfword Timers::control(int i) {
+    return mem.io_halfword(TM0CNT_H + i * TIMER_STRIDE);
+}
+
+uint64_t Timers::period(int i) {
+    return (0x10000 - timers[i].reload) * timers[i].tick_cycles;
+}
+
+// next_overflow is only kept up to date by the overflow events, timers without events catch up here
+uint64_t Timers::next_overflow_after(int i, uint64_t time) {
+    uint64_t next = timers[i].next_overflow;
+    if (time >= next) next += period(i) * (1 + (time - next) / period(i));
+    return next;
+}
+
+// The counter increments at next_overflow - k * tick_cycles, it is 0x10000 minus the increments left
+halfword Timers::counter_at(int i, uint64_t time) {
+    Timer& timer = timers[i];
+    if (!timer.running) return timer.counter;
+    uint64_t remaining = (next_overflow_after(i, time) - time + timer.tick_cycles - 1) / timer.tick_cycles;
+    return 0x10000 - remaining;
+}
+
+// Last timer of the cascade chain counting the overflows of timer i
+int Timers::cascade_end(int i) {
+    while (i < 3 && (control(i + 1) & 0x84) == 0x84) {
+        i++;
+    }
+    return i;
+}
+
+// Runs the timer from value at time. A cascade increments on the overflows of the previous timer, so its
+// own overflow time follows from the previous timer's next overflow and period
+void Timers::start(int i, uint64_t time, halfword value) {
+    Timer& timer = timers[i];
+    halfword cnt = control(i);
+    if (i > 0 && (cnt & 0x4)) {
+        if (!timers[i - 1].running) {
+            stop(i, time);
+            timer.counter = value;
+            return;
+        }
+        timer.tick_cycles   = period(i - 1);
+        timer.next_overflow = next_overflow_after(i - 1, time) + (0xFFFF - value) * timer.tick_cycles;
+    } else {
+        timer.tick_cycles   = uint64_t(1) << prescaler_shift[cnt & 0x3];
+        timer.next_overflow = time + (0x10000 - value) * timer.tick_cycles;
+    }
+    timer.running = true;
+    schedule_overflow(i);
+}
+
+void Timers::stop(int i, uint64_t time) {
+    timers[i].counter = counter_at(i, time);
+    timers[i].running = false;
+    scheduler.cancel(static_cast<EVENT>(EVENT_TIMER0 + i));
+}
+
+// Timers 0 and 1 clock the sound FIFOs, the others only need events for their interrupt
+void Timers::schedule_overflow(int i) {
+    EVENT event = static_cast<EVENT>(EVENT_TIMER0 + i);
+    if (timers[i].running && (i < 2 || (control(i) & 0x40))) {
+        scheduler.schedule_at(event, timers[i].next_overflow);
+    } else {
+        scheduler.cancel(event);
+    }
+}
+
+// Writes to TMxCNT_L only set the reload value, it is used from the next overflow on. The cascades
+// counting on the written timer are restarted from their current value with its new period.
+void Timers::io_written(void* owner, int offset, halfword old_value, halfword) {
+    Timers* self  = static_cast<Timers*>(owner);
+    int i         = (offset - TM0CNT_L) / TIMER_STRIDE;
+    Timer& timer  = self->timers[i];
+    halfword& reg = self->mem.io_halfword(offset);
+    uint64_t now  = self->scheduler.now();
+    int last      = self->cascade_end(i);
+    halfword values[4];
+    for (int j = i + 1; j <= last; j++) {
+        values[j] = self->counter_at(j, now);
+    }
+    // timers without an overflow event catch up before their period or their event changes
+    if (timer.running && !self->scheduler.is_scheduled(static_cast<EVENT>(EVENT_TIMER0 + i))) {
+        timer.next_overflow = self->next_overflow_after(i, now);
+    }
+    if (offset == TM0CNT_L + i * TIMER_STRIDE) {
+        timer.reload = reg;
+        reg          = old_value;
+    } else if (!(reg & 0x80)) {
+        self->stop(i, now);
+    } else if (!(old_value & 0x80)) {
+        self->start(i, now, timer.reload);
+    } else if ((reg ^ old_value) & 0x7) {
+        self->start(i, now, self->counter_at(i, now));
+    } else {
+        self->schedule_overflow(i);
+    }
+    for (int j = i + 1; j <= last; j++) {
+        self->start(j, now, values[j]);
+    }
+}
+
+// Refreshes TMxCNT_L before it is read
+void Timers::io_read(void* owner, int offset) {
+    Timers* self                  = static_cast<Timers*>(owner);
+    self->mem.io_halfword(offset) = self->counter_at((offset - TM0CNT_L) / TIMER_STRIDE, self->scheduler.now());
+}
+
+// Handles a scheduled overflow at the exact cycle it happened. The FIFOs clocked by the timer play their
+// next sample, and sound DMA refills them once half of the 32 bytes are played
+void Timers::overflow(int i, uint64_t time) {
+    Timer& timer = timers[i];
+    if (!timer.running) return;
+    timer.next_overflow = time + period(i);
+    schedule_overflow(i);
+    if (i < 2) {
+        sound.timer_overflow(i, time);
+        halfword cnt_h = mem.io_halfword(SOUNDCNT_H);
+        for (int fifo = 0; fifo < 2; fifo++) {
+            if (((cnt_h >> (10 + fifo * 4)) & 1) == i && sound.fifo_size(fifo) <= 16) dma.trigger_fifo(fifo);
+        }
+    }
+    if (control(i) & 0x40) interrupts.request(static_cast<INTERRUPT>(IRQ_TIMER0 + i));
+}
+
+void Timers::sync_state(Savestate& state) {
+    for (Timer& timer : timers) {
+        state.sync(timer.running);
+        state.sync(timer.reload);
+        state.sync(timer.counter);
+        state.sync(timer.next_overflow);
+        state.sync(timer.tick_cycles);
+    }
+}
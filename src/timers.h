@@ -0,0 +1,57 @@
+#ifndef TIMERS_H
+#define TIMERS_H
+
+// https://problemkaputt.de/gbatek.htm#gbatimers
+#include <cstdint>
+
+#include "dma.h"
+#include "interrupts.h"
+#include "memory.h"
+#include "savestate.h"
+#include "scheduler.h"
+#include "soundsystem.h"
+#include "utils.h"
+
+// IO register offsets of timer 0, relative to IO_RAM_START. Timers are TIMER_STRIDE apart
+static const int TM0CNT_L     = 0x100;
+static const int TM0CNT_H     = 0x102;
+static const int TIMER_STRIDE = 0x4;
+
+// Timers are never ticked, a running timer only keeps the cycle of its next overflow and the cycles
+// per increment, the counter is derived from them when it is read. Overflows are scheduled ahead
+// when something has to happen on them.
+struct Timer {
+    bool running;            // enabled, and for cascades the previous timer is running too
+    halfword reload;         // written through TMxCNT_L, which reads back the counter
+    halfword counter;        // value while stopped
+    uint64_t next_overflow;  // while running
+    uint64_t tick_cycles;    // the prescaler, or the overflow period of the previous timer for cascades
+};
+
+class Timers {
+    private:
+    Memory& mem;
+    Scheduler& scheduler;
+    SoundSystem& sound;
+    DMA& dma;
+    InterruptController& interrupts;
+    Timer timers[4];
+
+    static void io_written(void* owner, int offset, halfword old_value, halfword mask);
+    static void io_read(void* owner, int offset);
+    halfword control(int timer);
+    uint64_t period(int timer);
+    uint64_t next_overflow_after(int timer, uint64_t time);
+    halfword counter_at(int timer, uint64_t time);
+    int cascade_end(int timer);
+    void start(int timer, uint64_t time, halfword value);
+    void stop(int timer, uint64_t time);
+    void schedule_overflow(int timer);
+
+    public:
+    Timers(Memory& mem, Scheduler& scheduler, SoundSystem& sound, DMA& dma, InterruptController& interrupts);
+    void overflow(int timer, uint64_t time);
+    void sync_state(Savestate& state);
+};
+
+#endif
@@ -12,4 +12,13 @@ void log_success(std::string message) {
 
 void log_warning(std::string message) {
     std::cout << "\x1b[33;1m[WARNING]" << message << "\x1b[m\n";
-}
\ No newline at end of file
+}
+// 64 bit FNV-1a, stable across hosts and runs
+uint64_t hash_bytes(const void* data, size_t size) {
+    const byte* bytes = static_cast<const byte*>(data);
+    uint64_t hash     = 0xCBF29CE484222325;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3;
+    }
+    return hash;
+}
@@ -1,6 +1,7 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
@@ -12,5 +13,6 @@ void log_error(std::string message);
 void log_success(std::string message);
 void log_warning(std::string message);
 void crash();
+uint64_t hash_bytes(const void* data, size_t size);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include "wav_sink.h"
+
+#include <chrono>
+
+#include "utils.h"
+
+WavSink::WavSink(AudioRing& _ring)
+    : ring(_ring), running(false), data_size(0) {
+}
+
+WavSink::~WavSink() {
+    stop();
+}
+
+bool WavSink::open(std::string filename) {
+    file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.good()) return false;
+    write_header();
+    return true;
+}
+
+// http://soundfile.sapp.org/doc/WaveFormat/
+void WavSink::write_header() {
+    auto put32 = [this](uint32_t v) { file.write(reinterpret_cast<const char*>(&v), 4); };
+    auto put16 = [this](uint16_t v) { file.write(reinterpret_cast<const char*>(&v), 2); };
+    file.seekp(0);
+    file.write("RIFF", 4);
+    put32(36 + data_size);
+    file.write("WAVEfmt ", 8);
+    put32(16);
+    put16(1);  // PCM
+    put16(2);  // channels
+    put32(OUTPUT_RATE);
+    put32(OUTPUT_RATE * sizeof(AudioFrame));
+    put16(sizeof(AudioFrame));
+    put16(16);  // bits per sample
+    file.write("data", 4);
+    put32(data_size);
+}
+
+void WavSink::start() {
+    if (running || !file.is_open()) return;
+    running = true;
+    thread  = std::thread(&WavSink::loop, this);
+}
+
+// Drains the ring, then fixes up the header sizes
+void WavSink::stop() {
+    if (!running) return;
+    running.store(false, std::memory_order_release);
+    thread.join();
+    write_header();
+    file.close();
+}
+
+void WavSink::loop() {
+    AudioFrame frames[1024];
+    while (true) {
+        int n = 0;
+        while (n < 1024 && ring.pop(frames[n])) {
+            n++;
+        }
+        if (n > 0) {
+            file.write(reinterpret_cast<const char*>(frames), n * sizeof(AudioFrame));
+            data_size += n * sizeof(AudioFrame);
+        } else if (!running.load(std::memory_order_acquire)) {
+            if (ring.empty()) break;
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    if (!file.good()) log_warning("Unable to write the WAV output");
+}
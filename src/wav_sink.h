@@ -0,0 +1,31 @@
+#ifndef WAV_SINK_H
+#define WAV_SINK_H
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "soundsystem.h"
+
+// Consumes the sound output on its own thread and writes it to a 16 bit stereo WAV file
+class WavSink {
+    private:
+    AudioRing& ring;
+    std::ofstream file;
+    std::thread thread;
+    std::atomic<bool> running;
+    uint32_t data_size;
+    void loop();
+    void write_header();
+
+    public:
+    WavSink(AudioRing& ring);
+    ~WavSink();
+    bool open(std::string filename);
+    void start();
+    void stop();
+};
+
+#endif
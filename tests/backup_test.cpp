@@ -0,0 +1,67 @@
+#include "../src/backup.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "test.h"
+
+static const size_t SRAM_START = 0x0E000000;
+static const char* SAVE_FILE   = "bin/backup_test.sav";
+
+static std::vector<byte> read_file(const char* filename) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    return std::vector<byte>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// A synchronous flush writes the mapping back, the file read on its own descriptor holds the writes
+static void test_flush() {
+    std::remove(SAVE_FILE);
+    Backup backup;
+    CHECK(backup.open(SAVE_FILE, BACKUP_SRAM, false));
+    for (int i = 0; i < 16; i++) {
+        backup.write_byte(SRAM_START + i, i);
+    }
+    CHECK(backup.flush(true));
+    std::vector<byte> contents = read_file(SAVE_FILE);
+    CHECK_EQUAL(contents.size(), size_t(SRAM_SIZE));
+    for (int i = 0; i < 16 && i < int(contents.size()); i++) {
+        CHECK_EQUAL(int(contents[i]), i);
+    }
+    CHECK_EQUAL(int(contents[16]), 0xFF);
+    CHECK(backup.flush(false));
+}
+
+// Writes reach the file without any flush when the process is killed, the pages live in the page cache
+static void test_crash() {
+    std::remove(SAVE_FILE);
+    pid_t pid = fork();
+    if (pid == 0) {
+        Backup backup;
+        if (!backup.open(SAVE_FILE, BACKUP_SRAM, false)) _exit(1);
+        backup.write_byte(SRAM_START + 0x100, 0x5A);
+        backup.write_byte(SRAM_START + 0x7FFF, 0xA5);
+        raise(SIGKILL);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+
+    Backup backup;
+    CHECK(backup.open(SAVE_FILE, BACKUP_SRAM, false));
+    CHECK_EQUAL(int(backup.read_byte(SRAM_START + 0x100)), 0x5A);
+    CHECK_EQUAL(int(backup.read_byte(SRAM_START + 0x7FFF)), 0xA5);
+    CHECK_EQUAL(int(backup.read_byte(SRAM_START)), 0xFF);
+    backup.close();
+    std::remove(SAVE_FILE);
+}
+
+int main() {
+    test_flush();
+    test_crash();
+    return test_result("backup");
+}
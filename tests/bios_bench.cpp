@@ -0,0 +1,45 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+#include "../src/bios.h"
+
+static const word EWRAM = 0x02000000;
+
+struct BenchCall {
+    const char* name;
+    int number;
+    word r0, r1, r2;
+};
+
+// Time per HLE call, arguments reset before every call
+int main() {
+    Memory mem;
+    BIOS bios(mem);
+    for (word i = 0; i < 0x4000; i += 4) {
+        mem.set_word(EWRAM + i, i * 0x9E3779B9);
+    }
+    mem.set_word(EWRAM + 0x8000, 0x10 | (0x1000 << 8));  // LZ77 header, 4 KB of output
+    const BenchCall calls[] = {
+        {"Div", SWI_DIV, word(-123456), 789, 0},
+        {"Sqrt", SWI_SQRT, 0x12345678, 0, 0},
+        {"ArcTan2", SWI_ARCTAN2, 0x1234, 0x2345, 0},
+        {"CpuSet 1 KB", SWI_CPU_SET, EWRAM, EWRAM + 0x10000, (1 << 26) | 256},
+        {"CpuSet 1 KB overlap", SWI_CPU_SET, EWRAM, EWRAM + 4, (1 << 26) | 256},
+        {"CpuFastSet 1 KB", SWI_CPU_FAST_SET, EWRAM, EWRAM + 0x10000, 256},
+        {"CpuFastSet 1 KB fill", SWI_CPU_FAST_SET, EWRAM, EWRAM + 0x10000, (1 << 24) | 256},
+        {"LZ77UnCompWram 4 KB", SWI_LZ77_UNCOMP_WRAM, EWRAM + 0x8000, EWRAM + 0x10000, 0},
+    };
+    const int iterations = 20000;
+    for (const BenchCall& call : calls) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            word r0 = call.r0, r1 = call.r1, r2 = call.r2, r3 = 0;
+            bios.call(call.number, r0, r1, r2, r3);
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << std::left << std::setw(24) << call.name << std::right << std::setw(10) << std::fixed
+                  << std::setprecision(1) << elapsed.count() / iterations << " ns/call\n";
+    }
+    return 0;
+}
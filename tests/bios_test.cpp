@@ -0,0 +1,136 @@
+#include "../src/interrupts.h"
+
+#include "test.h"
+
+static const word EWRAM = 0x02000000;
+
+static void fill(Memory& mem) {
+    for (word i = 0; i < 32; i++) {
+        mem.set_word(EWRAM + 4 * i, i + 1);
+    }
+}
+
+// Runs a single ARM instruction stored at the start of EWRAM
+static void run_arm(Memory& mem, CPU& cpu, word instruction) {
+    mem.set_word(EWRAM, instruction);
+    *cpu.get_reg(15) = EWRAM;
+    cpu.run();
+}
+
+static void test_cpu_set(Memory& mem, BIOS& bios) {
+    word r0, r1, r2, r3 = 0;
+
+    // CpuSet copies one unit at a time, a destination inside the source repeats the first units
+    fill(mem);
+    r0 = EWRAM, r1 = EWRAM + 4, r2 = (1 << 26) | 8;
+    bios.call(SWI_CPU_SET, r0, r1, r2, r3);
+    for (word i = 0; i <= 8; i++) {
+        CHECK_EQUAL(mem.get_word(EWRAM + 4 * i), word(1));
+    }
+    CHECK_EQUAL(mem.get_word(EWRAM + 4 * 9), word(10));
+
+    fill(mem);
+    r0 = EWRAM, r1 = EWRAM + 2, r2 = 8;
+    bios.call(SWI_CPU_SET, r0, r1, r2, r3);
+    for (word i = 0; i <= 8; i++) {
+        CHECK_EQUAL(mem.get_halfword(EWRAM + 2 * i), halfword(1));
+    }
+
+    // CpuFastSet reads eight words before writing them
+    fill(mem);
+    r0 = EWRAM, r1 = EWRAM + 4, r2 = 16;
+    bios.call(SWI_CPU_FAST_SET, r0, r1, r2, r3);
+    CHECK_EQUAL(mem.get_word(EWRAM), word(1));
+    for (word i = 1; i <= 8; i++) {
+        CHECK_EQUAL(mem.get_word(EWRAM + 4 * i), i);
+    }
+    CHECK_EQUAL(mem.get_word(EWRAM + 4 * 9), word(8));
+    for (word i = 10; i <= 16; i++) {
+        CHECK_EQUAL(mem.get_word(EWRAM + 4 * i), i);
+    }
+
+    // A source inside the destination, and disjoint ranges, match memmove
+    fill(mem);
+    r0 = EWRAM + 8, r1 = EWRAM, r2 = (1 << 26) | 8;
+    bios.call(SWI_CPU_SET, r0, r1, r2, r3);
+    for (word i = 0; i < 8; i++) {
+        CHECK_EQUAL(mem.get_word(EWRAM + 4 * i), i + 3);
+    }
+    fill(mem);
+    r0 = EWRAM, r1 = EWRAM + 0x100, r2 = 8;
+    bios.call(SWI_CPU_FAST_SET, r0, r1, r2, r3);
+    for (word i = 0; i < 8; i++) {
+        CHECK_EQUAL(mem.get_word(EWRAM + 0x100 + 4 * i), i + 1);
+    }
+
+    // Fill
+    r0 = EWRAM + 4, r1 = EWRAM + 0x200, r2 = (1 << 24) | 16;
+    bios.call(SWI_CPU_FAST_SET, r0, r1, r2, r3);
+    for (word i = 0; i < 16; i++) {
+        CHECK_EQUAL(mem.get_word(EWRAM + 0x200 + 4 * i), word(2));
+    }
+}
+
+// Results of the real BIOS for a few arguments, https://problemkaputt.de/gbatek.htm#biosarithmeticfunctions
+static void test_arithmetic(BIOS& bios) {
+    word r0 = -7, r1 = 2, r2 = 0, r3 = 0;
+    bios.call(SWI_DIV, r0, r1, r2, r3);
+    CHECK_EQUAL(r0, word(-3));
+    CHECK_EQUAL(r1, word(-1));
+    CHECK_EQUAL(r3, word(3));
+    r0 = 0x10000;
+    bios.call(SWI_SQRT, r0, r1, r2, r3);
+    CHECK_EQUAL(r0, word(0x100));
+    r0 = 0x4000, r1 = 0x4000;
+    bios.call(SWI_ARCTAN2, r0, r1, r2, r3);
+    CHECK_EQUAL(r0, word(0x2000));
+}
+
+static void test_intr_wait(Memory& mem, CPU& cpu) {
+    // VBlankIntrWait halts on the SWI while the handler has not acknowledged a VBlank
+    mem.set_halfword(BIOS_IF_ADDRESS, 0x1);  // old flag, discarded
+    run_arm(mem, cpu, 0xEF050000);
+    CHECK(cpu.is_halted());
+    CHECK_EQUAL(*cpu.get_reg(15), EWRAM);
+    CHECK_EQUAL(mem.io_halfword(IME), halfword(1));
+    CHECK_EQUAL(mem.get_halfword(BIOS_IF_ADDRESS), halfword(0));
+
+    // the interrupt wakes the CPU, its handler sets the flag and returns to the SWI
+    mem.set_halfword(IO_RAM_START + IE, 0x1);
+    mem.io_halfword(IF) = 0x1;
+    cpu.halt();
+    CHECK(!cpu.is_halted());
+    mem.set_halfword(BIOS_IF_ADDRESS, 0x3);
+    run_arm(mem, cpu, 0xEF050000);
+    CHECK(!cpu.is_halted());
+    CHECK_EQUAL(*cpu.get_reg(15), EWRAM + 4);
+    CHECK_EQUAL(mem.get_halfword(BIOS_IF_ADDRESS), halfword(0x2));
+
+    // IntrWait with r0 = 0 returns at once on a flag set earlier
+    mem.io_halfword(IF) = 0;
+    *cpu.get_reg(0) = 0;
+    *cpu.get_reg(1) = 0x2;
+    run_arm(mem, cpu, 0xEF040000);
+    CHECK(!cpu.is_halted());
+    CHECK_EQUAL(mem.get_halfword(BIOS_IF_ADDRESS), halfword(0));
+
+    // SWIs the HLE BIOS does not implement return to the next instruction
+    word cpsr = cpu.get_cpsr();
+    run_arm(mem, cpu, 0xEF010000);
+    CHECK_EQUAL(*cpu.get_reg(15), EWRAM + 4);
+    CHECK_EQUAL(cpu.get_cpsr(), cpsr);
+}
+
+int main() {
+    Memory mem;
+    CPU cpu(mem);
+    BIOS bios(mem);
+    Scheduler scheduler;
+    InterruptController interrupts(mem, cpu, scheduler);
+    cpu.set_hle_bios(&bios);
+
+    test_cpu_set(mem, bios);
+    test_arithmetic(bios);
+    test_intr_wait(mem, cpu);
+    return test_result("bios");
+}
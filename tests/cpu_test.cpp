@@ -0,0 +1,402 @@
+#include "../src/cpu.h"
+
+#include "test.h"
+
+static const word EWRAM = 0x02000000;
+static const word IMM   = 1 << 25;  // immediate operand 2
+
+typedef enum {
+    AND, EOR, SUB, RSB, ADD, ADC, SBC, RSC, TST, TEQ, CMP, CMN, ORR, MOV, BIC, MVN
+} ALU_OPCODE;
+
+typedef enum {
+    LSL, LSR, ASR, ROR
+} SHIFT_TYPE;
+
+// https://problemkaputt.de/gbatek.htm#armopcodesdataprocessingalu
+static word alu(ALU_OPCODE opcode, bool s, int rd, int rn, word operand) {
+    return 0xE0000000 | opcode << 21 | s << 20 | rn << 16 | rd << 12 | operand;
+}
+
+static word shift_imm(int rm, SHIFT_TYPE type, int amount) {
+    return amount << 7 | type << 5 | rm;
+}
+
+static word shift_reg(int rm, SHIFT_TYPE type, int rs) {
+    return rs << 8 | type << 5 | 1 << 4 | rm;
+}
+
+// https://problemkaputt.de/gbatek.htm#armopcodesmemoryblockdatatransferldmstm
+static word block(bool load, bool pre, bool up, bool s, bool writeback, int rn, halfword list) {
+    return 0xE8000000 | pre << 24 | up << 23 | s << 22 | writeback << 21 | load << 20 | rn << 16 | list;
+}
+
+// Runs a single ARM instruction stored at the start of EWRAM
+static void run_arm(Memory& mem, CPU& cpu, word instruction) {
+    mem.set_word(EWRAM, instruction);
+    *cpu.get_reg(15) = EWRAM;
+    cpu.run();
+}
+
+// NZCV in the low four bits
+static word flags(CPU& cpu) {
+    return cpu.get_cpsr() >> 28;
+}
+
+// CMP r0, #0 sets C, CMN r0, #0 clears it, both set Z and clear N and V
+static void set_carry(Memory& mem, CPU& cpu, bool carry) {
+    *cpu.get_reg(0) = 0;
+    run_arm(mem, cpu, alu(carry ? CMP : CMN, true, 0, 0, IMM | 0));
+}
+
+static void test_logical(Memory& mem, CPU& cpu) {
+    *cpu.get_reg(1) = 0xF0F0;
+    run_arm(mem, cpu, alu(AND, true, 2, 1, IMM | 0xFF));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0xF0));
+    CHECK_EQUAL(flags(cpu), word(0x0));
+    run_arm(mem, cpu, alu(AND, true, 2, 1, IMM | 0x0F));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0));
+    CHECK_EQUAL(flags(cpu), word(0x4));
+
+    run_arm(mem, cpu, alu(EOR, false, 2, 1, IMM | 0xFF));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0xF00F));
+    run_arm(mem, cpu, alu(ORR, false, 2, 1, IMM | 0x0F));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0xF0FF));
+    run_arm(mem, cpu, alu(BIC, false, 2, 1, IMM | 0xF0));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0xF000));
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, IMM | 0x12));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0x12));
+    run_arm(mem, cpu, alu(MVN, true, 2, 0, IMM | 0));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0xFFFFFFFF));
+    CHECK_EQUAL(flags(cpu), word(0x8));
+
+    // logical operations leave V and, without a shift, C
+    *cpu.get_reg(1) = 0x80000000;
+    run_arm(mem, cpu, alu(CMP, true, 0, 1, IMM | 1));
+    CHECK_EQUAL(flags(cpu), word(0x3));
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, IMM | 1));
+    CHECK_EQUAL(flags(cpu), word(0x3));
+
+    // TST and TEQ only set the flags
+    *cpu.get_reg(1) = 0xF0;
+    *cpu.get_reg(2) = 0x1234;
+    run_arm(mem, cpu, alu(TST, true, 2, 1, IMM | 0x0F));
+    CHECK_EQUAL(flags(cpu), word(0x7));
+    run_arm(mem, cpu, alu(TEQ, true, 2, 1, IMM | 0xF0));
+    CHECK_EQUAL(flags(cpu), word(0x7));
+    run_arm(mem, cpu, alu(TEQ, true, 2, 1, IMM | 0x0F));
+    CHECK_EQUAL(flags(cpu), word(0x3));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0x1234));
+}
+
+static void test_arithmetic(Memory& mem, CPU& cpu) {
+    *cpu.get_reg(1) = 5;
+    run_arm(mem, cpu, alu(SUB, true, 2, 1, IMM | 7));
+    CHECK_EQUAL(*cpu.get_reg(2), word(-2));
+    CHECK_EQUAL(flags(cpu), word(0x8));
+    run_arm(mem, cpu, alu(SUB, true, 2, 1, IMM | 5));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0));
+    CHECK_EQUAL(flags(cpu), word(0x6));
+    run_arm(mem, cpu, alu(RSB, true, 2, 1, IMM | 0));
+    CHECK_EQUAL(*cpu.get_reg(2), word(-5));
+    CHECK_EQUAL(flags(cpu), word(0x8));
+
+    *cpu.get_reg(1) = 0xFFFFFFFF;
+    run_arm(mem, cpu, alu(ADD, true, 2, 1, IMM | 1));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0));
+    CHECK_EQUAL(flags(cpu), word(0x6));
+    *cpu.get_reg(1) = 0x7FFFFFFF;
+    run_arm(mem, cpu, alu(ADD, true, 2, 1, IMM | 1));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0x80000000));
+    CHECK_EQUAL(flags(cpu), word(0x9));
+
+    // carry in
+    *cpu.get_reg(1) = 1;
+    set_carry(mem, cpu, true);
+    run_arm(mem, cpu, alu(ADC, true, 2, 1, IMM | 1));
+    CHECK_EQUAL(*cpu.get_reg(2), word(3));
+    CHECK_EQUAL(flags(cpu), word(0x0));
+    *cpu.get_reg(1) = 0xFFFFFFFF;
+    set_carry(mem, cpu, true);
+    run_arm(mem, cpu, alu(ADC, true, 2, 1, IMM | 0));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0));
+    CHECK_EQUAL(flags(cpu), word(0x6));
+
+    *cpu.get_reg(1) = 5;
+    set_carry(mem, cpu, false);
+    run_arm(mem, cpu, alu(SBC, true, 2, 1, IMM | 1));
+    CHECK_EQUAL(*cpu.get_reg(2), word(3));
+    CHECK_EQUAL(flags(cpu), word(0x2));
+    set_carry(mem, cpu, true);
+    run_arm(mem, cpu, alu(SBC, true, 2, 1, IMM | 5));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0));
+    CHECK_EQUAL(flags(cpu), word(0x6));
+    *cpu.get_reg(1) = 0;
+    set_carry(mem, cpu, false);
+    run_arm(mem, cpu, alu(SBC, true, 2, 1, IMM | 0));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0xFFFFFFFF));
+    CHECK_EQUAL(flags(cpu), word(0x8));
+
+    *cpu.get_reg(1) = 1;
+    set_carry(mem, cpu, true);
+    run_arm(mem, cpu, alu(RSC, true, 2, 1, IMM | 5));
+    CHECK_EQUAL(*cpu.get_reg(2), word(4));
+    CHECK_EQUAL(flags(cpu), word(0x2));
+    set_carry(mem, cpu, false);
+    run_arm(mem, cpu, alu(RSC, true, 2, 1, IMM | 1));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0xFFFFFFFF));
+    CHECK_EQUAL(flags(cpu), word(0x8));
+
+    // CMP and CMN only set the flags
+    *cpu.get_reg(1) = 0x80000000;
+    *cpu.get_reg(2) = 0x1234;
+    run_arm(mem, cpu, alu(CMP, true, 2, 1, IMM | 1));
+    CHECK_EQUAL(flags(cpu), word(0x3));
+    run_arm(mem, cpu, alu(CMN, true, 2, 1, IMM | 0));
+    CHECK_EQUAL(flags(cpu), word(0x8));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0x1234));
+}
+
+static void test_shifter(Memory& mem, CPU& cpu) {
+    // immediates rotated by a non-zero amount set C to bit 31
+    set_carry(mem, cpu, false);
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, IMM | 1 << 8 | 0x02));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0x80000000));
+    CHECK_EQUAL(flags(cpu), word(0xA));
+
+    // shifts by an immediate, 0 means LSR #32, ASR #32 and RRX
+    *cpu.get_reg(1) = 0x10000001;
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, shift_imm(1, LSL, 4)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0x10));
+    CHECK_EQUAL(flags(cpu), word(0x2));
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, shift_imm(1, LSR, 1)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0x08000000));
+    CHECK_EQUAL(flags(cpu), word(0x2));
+    *cpu.get_reg(1) = 0x80000000;
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, shift_imm(1, LSR, 0)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0));
+    CHECK_EQUAL(flags(cpu), word(0x6));
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, shift_imm(1, ASR, 4)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0xF8000000));
+    CHECK_EQUAL(flags(cpu), word(0x8));
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, shift_imm(1, ASR, 0)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0xFFFFFFFF));
+    CHECK_EQUAL(flags(cpu), word(0xA));
+    *cpu.get_reg(1) = 0xFF;
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, shift_imm(1, ROR, 8)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0xFF000000));
+    CHECK_EQUAL(flags(cpu), word(0xA));
+    *cpu.get_reg(1) = 0x2;
+    set_carry(mem, cpu, true);
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, shift_imm(1, ROR, 0)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0x80000001));
+    CHECK_EQUAL(flags(cpu), word(0x8));
+
+    // shifts by the low byte of a register, 0 leaves the value and C
+    *cpu.get_reg(1) = 0x1;
+    *cpu.get_reg(3) = 0x100;
+    set_carry(mem, cpu, true);
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, shift_reg(1, LSL, 3)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0x1));
+    CHECK_EQUAL(flags(cpu), word(0x2));
+    *cpu.get_reg(3) = 32;
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, shift_reg(1, LSL, 3)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0));
+    CHECK_EQUAL(flags(cpu), word(0x6));
+    *cpu.get_reg(3) = 33;
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, shift_reg(1, LSL, 3)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0));
+    CHECK_EQUAL(flags(cpu), word(0x4));
+    *cpu.get_reg(1) = 0x80000000;
+    *cpu.get_reg(3) = 32;
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, shift_reg(1, LSR, 3)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0));
+    CHECK_EQUAL(flags(cpu), word(0x6));
+    *cpu.get_reg(3) = 40;
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, shift_reg(1, ASR, 3)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0xFFFFFFFF));
+    CHECK_EQUAL(flags(cpu), word(0xA));
+    *cpu.get_reg(3) = 32;
+    run_arm(mem, cpu, alu(MOV, true, 2, 0, shift_reg(1, ROR, 3)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0x80000000));
+    CHECK_EQUAL(flags(cpu), word(0xA));
+    *cpu.get_reg(1) = 0x3;
+    *cpu.get_reg(3) = 1;
+    run_arm(mem, cpu, alu(ADD, false, 2, 1, shift_reg(1, LSL, 3)));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0x9));
+}
+
+// r15 reads as the instruction address + 8, + 12 with a shift by register
+static void test_pc_operand(Memory& mem, CPU& cpu) {
+    run_arm(mem, cpu, alu(MOV, false, 2, 0, 15));
+    CHECK_EQUAL(*cpu.get_reg(2), EWRAM + 8);
+    run_arm(mem, cpu, alu(ADD, false, 2, 15, IMM | 4));
+    CHECK_EQUAL(*cpu.get_reg(2), EWRAM + 12);
+    *cpu.get_reg(3) = 0;
+    run_arm(mem, cpu, alu(ADD, false, 2, 15, shift_reg(15, LSL, 3)));
+    CHECK_EQUAL(*cpu.get_reg(2), 2 * (EWRAM + 12));
+
+    // a write to r15 branches
+    *cpu.get_reg(1) = EWRAM + 0x102;
+    run_arm(mem, cpu, alu(MOV, false, 15, 0, 1));
+    CHECK_EQUAL(*cpu.get_reg(15), EWRAM + 0x100);
+}
+
+// SUBS PC, LR, #4 at the end of an IRQ handler returns and restores the CPSR
+static void test_exception_return(Memory& mem, CPU& cpu) {
+    word cpsr        = cpu.get_cpsr();
+    word sp          = *cpu.get_reg(13);
+    *cpu.get_reg(15) = EWRAM + 0x40;
+    cpu.interrupt();
+    CHECK(cpu.get_cpsr() != cpsr);
+    run_arm(mem, cpu, alu(SUB, true, 15, 14, IMM | 4));
+    CHECK_EQUAL(cpu.get_cpsr(), cpsr);
+    CHECK_EQUAL(*cpu.get_reg(15), EWRAM + 0x40);
+    CHECK_EQUAL(*cpu.get_reg(13), sp);
+}
+
+// https://problemkaputt.de/gbatek.htm#armopcodesbranchandbranchwithlinkbblbxblxswibkpt
+static void test_branch_exchange(Memory& mem, CPU& cpu) {
+    *cpu.get_reg(1) = EWRAM + 0x101;
+    run_arm(mem, cpu, 0xE12FFF11);  // BX r1
+    CHECK_EQUAL(*cpu.get_reg(15), EWRAM + 0x100);
+    CHECK(cpu.get_cpsr() & STATE_BIT);
+
+    *cpu.get_reg(1) = EWRAM + 0x200;
+    cpu.arm_branch_exchange(0xE12FFF11);
+    CHECK_EQUAL(*cpu.get_reg(15), EWRAM + 0x200);
+    CHECK(!(cpu.get_cpsr() & STATE_BIT));
+    mem.set_word(EWRAM + 0x200, alu(MOV, false, 2, 0, IMM | 7));
+    cpu.run();
+    CHECK_EQUAL(*cpu.get_reg(2), word(7));
+    CHECK_EQUAL(*cpu.get_reg(15), EWRAM + 0x204);
+}
+
+// An empty list transfers r15 and moves the base by 0x40, as if all 16 registers were in the list
+static void test_block_empty_list(Memory& mem, CPU& cpu) {
+    *cpu.get_reg(1) = EWRAM + 0x100;
+    run_arm(mem, cpu, block(false, false, true, false, true, 1, 0));  // STMIA r1!, {}
+    CHECK_EQUAL(mem.get_word(EWRAM + 0x100), EWRAM + 12);
+    CHECK_EQUAL(*cpu.get_reg(1), EWRAM + 0x140);
+
+    // decrementing, r15 goes to the lowest of the 16 words
+    mem.set_word(EWRAM + 0x200, 0);
+    *cpu.get_reg(1) = EWRAM + 0x240;
+    run_arm(mem, cpu, block(false, true, false, false, true, 1, 0));  // STMDB r1!, {}
+    CHECK_EQUAL(mem.get_word(EWRAM + 0x200), EWRAM + 12);
+    CHECK_EQUAL(*cpu.get_reg(1), EWRAM + 0x200);
+
+    mem.set_word(EWRAM + 0x300, EWRAM + 0x402);
+    *cpu.get_reg(1) = EWRAM + 0x300;
+    run_arm(mem, cpu, block(true, false, true, false, true, 1, 0));  // LDMIA r1!, {}
+    CHECK_EQUAL(*cpu.get_reg(15), EWRAM + 0x400);
+    CHECK_EQUAL(*cpu.get_reg(1), EWRAM + 0x340);
+}
+
+// A stored base is the original value when it is the first register in the list and the written back
+// value otherwise, a loaded base overrides the writeback
+static void test_block_base_in_list(Memory& mem, CPU& cpu) {
+    *cpu.get_reg(1) = EWRAM + 0x100;
+    *cpu.get_reg(2) = 0x22;
+    run_arm(mem, cpu, block(false, false, true, false, true, 1, 0x0006));  // STMIA r1!, {r1, r2}
+    CHECK_EQUAL(mem.get_word(EWRAM + 0x100), EWRAM + 0x100);
+    CHECK_EQUAL(mem.get_word(EWRAM + 0x104), word(0x22));
+    CHECK_EQUAL(*cpu.get_reg(1), EWRAM + 0x108);
+
+    *cpu.get_reg(1) = 0x11;
+    *cpu.get_reg(2) = EWRAM + 0x100;
+    run_arm(mem, cpu, block(false, false, true, false, true, 2, 0x0006));  // STMIA r2!, {r1, r2}
+    CHECK_EQUAL(mem.get_word(EWRAM + 0x100), word(0x11));
+    CHECK_EQUAL(mem.get_word(EWRAM + 0x104), EWRAM + 0x108);
+    CHECK_EQUAL(*cpu.get_reg(2), EWRAM + 0x108);
+
+    // same when decrementing, the written back value is the lowest address
+    *cpu.get_reg(1) = 0x11;
+    *cpu.get_reg(2) = EWRAM + 0x108;
+    run_arm(mem, cpu, block(false, true, false, false, true, 2, 0x0006));  // STMDB r2!, {r1, r2}
+    CHECK_EQUAL(mem.get_word(EWRAM + 0x104), EWRAM + 0x100);
+
+    mem.set_word(EWRAM + 0x100, 0xAA);
+    mem.set_word(EWRAM + 0x104, 0xBB);
+    *cpu.get_reg(1) = EWRAM + 0x100;
+    run_arm(mem, cpu, block(true, false, true, false, true, 1, 0x0003));  // LDMIA r1!, {r0, r1}
+    CHECK_EQUAL(*cpu.get_reg(0), word(0xAA));
+    CHECK_EQUAL(*cpu.get_reg(1), word(0xBB));
+    *cpu.get_reg(2) = EWRAM + 0x100;
+    run_arm(mem, cpu, block(true, false, true, false, true, 2, 0x0006));  // LDMIA r2!, {r1, r2}
+    CHECK_EQUAL(*cpu.get_reg(1), word(0xAA));
+    CHECK_EQUAL(*cpu.get_reg(2), word(0xBB));
+}
+
+// With the S bit and without r15 in a load, the user bank is transferred whatever the current mode
+static void test_block_user_bank(Memory& mem, CPU& cpu) {
+    word cpsr        = cpu.get_cpsr();
+    *cpu.get_reg(13) = 0x1313;
+    *cpu.get_reg(14) = 0x1414;
+    *cpu.get_reg(15) = EWRAM + 0x40;
+    cpu.interrupt();
+    word irq_sp      = *cpu.get_reg(13);
+    *cpu.get_reg(1)  = EWRAM + 0x100;
+    run_arm(mem, cpu, block(false, false, true, true, false, 1, 0x6000));  // STMIA r1, {r13, r14}^
+    CHECK_EQUAL(mem.get_word(EWRAM + 0x100), word(0x1313));
+    CHECK_EQUAL(mem.get_word(EWRAM + 0x104), word(0x1414));
+
+    mem.set_word(EWRAM + 0x100, 0x3131);
+    run_arm(mem, cpu, block(true, false, true, true, false, 1, 0x2000));  // LDMIA r1, {r13}^
+    CHECK_EQUAL(*cpu.get_reg(13), irq_sp);
+
+    // a load of r15 with the S bit uses the current bank and returns, restoring the CPSR
+    mem.set_word(EWRAM + 0x100, 0x7777);
+    mem.set_word(EWRAM + 0x104, EWRAM + 0x43);
+    run_arm(mem, cpu, block(true, false, true, true, false, 1, 0x8004));  // LDMIA r1, {r2, r15}^
+    CHECK_EQUAL(cpu.get_cpsr(), cpsr);
+    CHECK_EQUAL(*cpu.get_reg(15), EWRAM + 0x40);
+    CHECK_EQUAL(*cpu.get_reg(2), word(0x7777));
+    CHECK_EQUAL(*cpu.get_reg(13), word(0x3131));
+    CHECK_EQUAL(*cpu.get_reg(14), word(0x1414));
+
+    // without it only r15 changes
+    mem.set_word(EWRAM + 0x100, EWRAM + 0x82);
+    run_arm(mem, cpu, block(true, false, true, false, false, 1, 0x8000));  // LDMIA r1, {r15}
+    CHECK_EQUAL(*cpu.get_reg(15), EWRAM + 0x80);
+    CHECK_EQUAL(cpu.get_cpsr(), cpsr);
+}
+
+// A transfer running past the end of a region is not copied through one pointer, each word goes
+// through Memory and lands in the mirror
+static void test_block_region_boundary(Memory& mem, CPU& cpu) {
+    for (int r = 2; r < 6; r++) {
+        *cpu.get_reg(r) = 0x100 * r;
+    }
+    *cpu.get_reg(1) = EWRAM + 0x3FFF8;
+    run_arm(mem, cpu, block(false, false, true, false, true, 1, 0x003C));  // STMIA r1!, {r2-r5}
+    CHECK_EQUAL(mem.get_word(EWRAM + 0x3FFF8), word(0x200));
+    CHECK_EQUAL(mem.get_word(EWRAM + 0x3FFFC), word(0x300));
+    CHECK_EQUAL(mem.get_word(EWRAM), word(0x400));
+    CHECK_EQUAL(mem.get_word(EWRAM + 4), word(0x500));
+    CHECK_EQUAL(*cpu.get_reg(1), EWRAM + 0x40008);
+
+    mem.set_word(EWRAM + 0x100, block(true, true, false, false, false, 1, 0x03C0));  // LDMDB r1, {r6-r9}
+    *cpu.get_reg(15) = EWRAM + 0x100;
+    cpu.run();
+    for (int r = 6; r < 10; r++) {
+        CHECK_EQUAL(*cpu.get_reg(r), word(0x100 * (r - 4)));
+    }
+}
+
+int main() {
+    Memory mem;
+    CPU cpu(mem);
+
+    test_logical(mem, cpu);
+    test_arithmetic(mem, cpu);
+    test_shifter(mem, cpu);
+    test_pc_operand(mem, cpu);
+    test_exception_return(mem, cpu);
+    test_branch_exchange(mem, cpu);
+    test_block_empty_list(mem, cpu);
+    test_block_base_in_list(mem, cpu);
+    test_block_user_bank(mem, cpu);
+    test_block_region_boundary(mem, cpu);
+    return test_result("cpu");
+}
@@ -0,0 +1,84 @@
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "../src/display.h"
+#include "../src/profiler.h"
+
+static const word IO   = 0x04000000;
+static const word PAL  = 0x05000000;
+static const word VRAM = 0x06000000;
+static const word OAM  = 0x07000000;
+
+struct BenchEffect {
+    const char* name;
+    halfword bldcnt;
+};
+
+// The four text BGs with holes over each other and a row of OBJs, without semi-transparent OBJs so that
+// every effect takes its own path
+static void build_scene(Memory& mem) {
+    for (word i = 0; i < 0x200; i += 2) {
+        mem.set_halfword(PAL + i, i * 0x9E37);
+        mem.set_halfword(PAL + 0x200 + i, i * 0x7F4A);
+    }
+    for (word i = 0; i < 0x8000; i += 4) {
+        mem.set_word(VRAM + i, i * 0x9E3779B9);
+        mem.set_word(VRAM + 0x10000 + i, i * 0x85EBCA6B);
+    }
+    for (int bg = 0; bg < 4; bg++) {
+        word screen = 0xC000 + bg * 0x800;
+        for (word i = 0; i < 0x800; i += 2) {
+            mem.set_halfword(VRAM + screen + i, ((i * 37 + bg) & 0x1FF) | ((i & 0xF) << 12));
+        }
+        mem.set_halfword(IO + BG0CNT + bg * 2, ((screen / 0x800) << 8) | (bg & 3));
+    }
+    for (int i = 0; i < 128; i++) {
+        // 32 OBJs of 32x32 spread over every line, the others disabled
+        mem.set_halfword(OAM + i * 8, i < 32 ? (i * 5) & 0xFF : 0x200);
+        mem.set_halfword(OAM + i * 8 + 2, 0x8000 | ((i * 7) & 0x1FF));
+        mem.set_halfword(OAM + i * 8 + 4, (i % 4) << 10 | (i % 16) << 12 | (i * 16));
+    }
+    mem.set_halfword(IO + BLDALPHA, 0x060A);
+    mem.set_halfword(IO + BLDY, 0x0008);
+    mem.set_halfword(IO + WIN0H, 0x20C0);
+    mem.set_halfword(IO + WIN0V, 0x1080);
+    mem.set_halfword(IO + WIN1H, 0x6090);
+    mem.set_halfword(IO + WIN1V, 0x0040);
+    mem.set_halfword(IO + WININ, 0x1F3F);
+    mem.set_halfword(IO + WINOUT, 0x3B1D);
+}
+
+// Time in Display::composite per scanline, from its profiler sections, for each effect with and without windows
+int main() {
+    Memory mem;
+    Display display(mem);
+    build_scene(mem);
+    const BenchEffect effects[] = {
+        {"none", 0x0000},
+        {"alpha", 0x3E51},
+        {"brighten", 0x0095},
+        {"darken", 0x00D3},
+    };
+    const int frames = 200;
+    for (bool windows : {false, true}) {
+        mem.set_halfword(IO + DISPCNT, windows ? 0x7F40 : 0x1F40);
+        for (const BenchEffect& effect : effects) {
+            mem.set_halfword(IO + BLDCNT, effect.bldcnt);
+            profiler.reset();
+            for (int frame = 0; frame < frames; frame++) {
+                for (int line = 0; line < SCREEN_HEIGHT; line++) {
+                    display.render_scanline(line);
+                }
+            }
+            uint64_t ns = 0;
+            for (PROFILER_SECTION section : {COMPOSITE_COPY, COMPOSITE_WINDOW, COMPOSITE_ALPHA, COMPOSITE_BRIGHTNESS}) {
+                ns += profiler.get_total_ns(section);
+            }
+            std::cout << std::left << std::setw(24) << (std::string(effect.name) + (windows ? " + windows" : ""))
+                      << std::right << std::setw(10) << std::fixed << std::setprecision(1)
+                      << double(ns) / (frames * SCREEN_HEIGHT) << " ns/line\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include "../src/display.h"
+
+#include "test.h"
+
+static const word IO   = 0x04000000;
+static const word PAL  = 0x05000000;
+static const word VRAM = 0x06000000;
+static const word OAM  = 0x07000000;
+
+static const halfword BACKDROP = 0x7C00;
+static const halfword RED      = 0x001F;  // BG0
+static const halfword GREY     = 0x5294;  // OBJ palette 0
+static const halfword YELLOW   = 0x03FF;  // OBJ palette 1
+
+// Mode 0 with BG0 covering the screen in RED, 8x8 OBJs use a tile of color 1 at x = 8
+struct Scene {
+    Memory mem;
+    Display display;
+
+    Scene() : display(mem) {
+        mem.set_halfword(PAL, BACKDROP);
+        mem.set_halfword(PAL + 2, RED);
+        mem.set_halfword(PAL + 0x202, GREY);
+        mem.set_halfword(PAL + 0x222, YELLOW);
+        for (word i = 0; i < 32; i += 4) {
+            mem.set_word(VRAM + 32 + i, 0x11111111);          // BG tile 1
+            mem.set_word(VRAM + 0x10000 + 32 + i, 0x11111111);  // OBJ tile 1
+        }
+        for (word i = 0; i < 0x800; i += 2) {
+            mem.set_halfword(VRAM + 0xF800 + i, 1);
+        }
+        for (int i = 0; i < 128; i++) {
+            mem.set_halfword(OAM + i * 8, 0x200);  // disabled
+        }
+        mem.set_halfword(IO + BG0CNT, 0x1F00);  // screen base 31, priority 0
+        mem.set_halfword(IO + DISPCNT, 0x1140);  // BG0, OBJ, 1D mapping
+    }
+
+    // https://problemkaputt.de/gbatek.htm#lcdobjoamattributes
+    void set_obj(int i, int priority, int palette, bool semi_transparent) {
+        mem.set_halfword(OAM + i * 8, semi_transparent ? 0x400 : 0);
+        mem.set_halfword(OAM + i * 8 + 2, 8);
+        mem.set_halfword(OAM + i * 8 + 4, palette << 12 | priority << 10 | 1);
+    }
+
+    void set_bg_priority(int priority) {
+        mem.set_halfword(IO + BG0CNT, 0x1F00 | priority);
+    }
+
+    // Pixels of line 4 at x = 0 (BG0 only) and x = 8 (BG0 under the OBJs)
+    halfword pixel(int x) {
+        display.render_scanline(4);
+        return display.get_framebuffer()[4 * SCREEN_WIDTH + x];
+    }
+};
+
+// https://problemkaputt.de/gbatek.htm#lcdobjoverview
+// OBJs are drawn over BGs of the same or lower priority
+static void test_obj_over_bg() {
+    Scene scene;
+    scene.set_obj(0, 1, 0, false);
+    for (int priority = 0; priority < 4; priority++) {
+        scene.set_bg_priority(priority);
+        CHECK_EQUAL(scene.pixel(0), RED);
+        CHECK_EQUAL(scene.pixel(8), priority < 1 ? RED : GREY);
+    }
+    scene.mem.set_halfword(IO + DISPCNT, 0x1040);
+    CHECK_EQUAL(scene.pixel(0), BACKDROP);
+    CHECK_EQUAL(scene.pixel(8), GREY);
+}
+
+// Between OBJs the lower priority value wins, the lower OAM index on equal priorities
+static void test_obj_order() {
+    Scene scene;
+    scene.set_bg_priority(3);
+    scene.set_obj(3, 1, 0, false);
+    scene.set_obj(5, 1, 1, false);
+    CHECK_EQUAL(scene.pixel(8), GREY);
+    scene.set_obj(5, 0, 1, false);
+    CHECK_EQUAL(scene.pixel(8), YELLOW);
+    scene.set_obj(3, 0, 0, false);
+    CHECK_EQUAL(scene.pixel(8), GREY);
+
+    // the winning OBJ is then ordered against the BGs with its own priority
+    scene.set_obj(3, 2, 0, false);
+    scene.set_obj(5, 1, 1, false);
+    scene.set_bg_priority(1);
+    CHECK_EQUAL(scene.pixel(8), YELLOW);
+    scene.set_bg_priority(0);
+    CHECK_EQUAL(scene.pixel(8), RED);
+}
+
+// https://problemkaputt.de/gbatek.htm#lcdiocolorspecialeffects
+static void test_blend() {
+    Scene scene;
+    scene.set_bg_priority(1);
+    scene.set_obj(0, 1, 0, false);
+
+    // alpha, (20 * 12 + 31 * 6) / 16 = 26 in red and 20 * 12 / 16 = 15 in green and blue
+    scene.mem.set_halfword(IO + BLDCNT, 0x0150);
+    scene.mem.set_halfword(IO + BLDALPHA, 0x060C);
+    CHECK_EQUAL(scene.pixel(0), RED);
+    CHECK_EQUAL(scene.pixel(8), halfword(0x3DFA));
+    // coefficients above 16 count as 16, the sum saturates at 31
+    scene.mem.set_halfword(IO + BLDALPHA, 0x1F1F);
+    CHECK_EQUAL(scene.pixel(8), halfword(0x529F));
+    // the second target must be directly below
+    scene.mem.set_halfword(IO + BLDCNT, 0x2050);
+    CHECK_EQUAL(scene.pixel(8), GREY);
+
+    // brightness increase on BG0, 31 * 8 / 16 = 15 added to green and blue
+    scene.mem.set_halfword(IO + BLDCNT, 0x0081);
+    scene.mem.set_halfword(IO + BLDY, 8);
+    CHECK_EQUAL(scene.pixel(0), halfword(0x3DFF));
+    CHECK_EQUAL(scene.pixel(8), GREY);
+
+    // brightness decrease on the OBJ, 20 * 4 / 16 = 5 taken from every component
+    scene.mem.set_halfword(IO + BLDCNT, 0x00D0);
+    scene.mem.set_halfword(IO + BLDY, 4);
+    CHECK_EQUAL(scene.pixel(0), RED);
+    CHECK_EQUAL(scene.pixel(8), halfword(0x3DEF));
+
+    // semi-transparent OBJs take the brightness effect without a second target below, and are alpha blended
+    // over one whatever the effect
+    scene.set_obj(0, 1, 0, true);
+    scene.mem.set_halfword(IO + BLDALPHA, 0x060C);
+    CHECK_EQUAL(scene.pixel(8), halfword(0x3DEF));
+    scene.mem.set_halfword(IO + BLDCNT, 0x01C0);
+    CHECK_EQUAL(scene.pixel(8), halfword(0x3DFA));
+    scene.mem.set_halfword(IO + BLDCNT, 0x0100);
+    CHECK_EQUAL(scene.pixel(8), halfword(0x3DFA));
+}
+
+// https://problemkaputt.de/gbatek.htm#lcdiowindowfeature
+// Effects only apply where the window enables them
+static void test_window_effects() {
+    Scene scene;
+    scene.set_bg_priority(1);
+    scene.set_obj(0, 1, 0, false);
+    scene.mem.set_halfword(IO + BLDCNT, 0x0150);
+    scene.mem.set_halfword(IO + BLDALPHA, 0x060C);
+    scene.mem.set_halfword(IO + WIN0H, 0x0010);
+    scene.mem.set_halfword(IO + WIN0V, 0x00A0);
+    scene.mem.set_halfword(IO + WININ, 0x001F);
+    scene.mem.set_halfword(IO + WINOUT, 0x003F);
+    scene.mem.set_halfword(IO + DISPCNT, 0x3140);
+    CHECK_EQUAL(scene.pixel(8), GREY);
+    scene.mem.set_halfword(IO + WININ, 0x003F);
+    CHECK_EQUAL(scene.pixel(8), halfword(0x3DFA));
+    // outside of the window the OBJ is hidden
+    scene.mem.set_halfword(IO + WIN0H, 0x0008);
+    scene.mem.set_halfword(IO + WINOUT, 0x0021);
+    CHECK_EQUAL(scene.pixel(8), RED);
+}
+
+int main() {
+    test_obj_over_bg();
+    test_obj_order();
+    test_blend();
+    test_window_effects();
+    return test_result("display");
+}
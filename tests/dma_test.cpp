@@ -0,0 +1,60 @@
+#include "../src/dma.h"
+
+#include "test.h"
+
+static const word EWRAM = 0x02000000;
+static const word DMA3  = 3 * DMA_CHANNEL_STRIDE;
+static const word IO    = 0x04000000;
+
+// Immediate 32 bit DMA3 of count words, incrementing both addresses
+static void dma_words(Memory& mem, word source, word dest, halfword count) {
+    mem.set_word(IO + DMA0SAD + DMA3, source);
+    mem.set_word(IO + DMA0DAD + DMA3, dest);
+    mem.set_halfword(IO + DMA0CNT_L + DMA3, count);
+    mem.set_halfword(IO + DMA0CNT_H + DMA3, 0x8400);
+}
+
+static void fill(Memory& mem) {
+    for (word i = 0; i < 16; i++) {
+        mem.set_word(EWRAM + 4 * i, i + 1);
+    }
+}
+
+int main() {
+    Memory mem;
+    CPU cpu(mem);
+    Scheduler scheduler;
+    InterruptController interrupts(mem, cpu, scheduler);
+    DMA dma(mem, scheduler, interrupts);
+
+    // The destination starts inside the source: every unit reads back the first one
+    fill(mem);
+    dma_words(mem, EWRAM, EWRAM + 4, 8);
+    for (word i = 0; i <= 8; i++) {
+        CHECK_EQUAL(mem.get_word(EWRAM + 4 * i), word(1));
+    }
+    CHECK_EQUAL(mem.get_word(EWRAM + 4 * 9), word(10));
+
+    // Same overlap through the 256 KB EWRAM mirror
+    fill(mem);
+    dma_words(mem, EWRAM, EWRAM + 0x40000 + 8, 8);
+    for (word i = 0; i < 10; i++) {
+        CHECK_EQUAL(mem.get_word(EWRAM + 4 * i), word(i < 2 ? i + 1 : (i % 2) + 1));
+    }
+
+    // The source starts inside the destination, a forward copy does not read back its writes
+    fill(mem);
+    dma_words(mem, EWRAM + 8, EWRAM, 8);
+    for (word i = 0; i < 8; i++) {
+        CHECK_EQUAL(mem.get_word(EWRAM + 4 * i), word(i + 3));
+    }
+    CHECK_EQUAL(mem.get_word(EWRAM + 4 * 8), word(9));
+
+    // Disjoint ranges
+    fill(mem);
+    dma_words(mem, EWRAM, EWRAM + 0x100, 16);
+    for (word i = 0; i < 16; i++) {
+        CHECK_EQUAL(mem.get_word(EWRAM + 0x100 + 4 * i), word(i + 1));
+    }
+    return test_result("dma");
+}
@@ -0,0 +1,198 @@
+#include "../src/emulator.h"
+#include "../src/profiler.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "test.h"
+
+static const char* ROM_FILE   = "bin/emulator_test.gba";
+static const char* MOVIE_FILE = "bin/emulator_test.movie";
+static const char* VIDEO_FILE = "bin/emulator_test.rgba";
+
+static const uint64_t MOVIE_FRAMES = 40;
+static const uint32_t KEYFRAMES    = 16;
+static const size_t FRAME_BYTES    = SCREEN_WIDTH * SCREEN_HEIGHT * 4;
+
+static void write_rom(const word* code, size_t size) {
+    std::ofstream file(ROM_FILE, std::ios::out | std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(code), size);
+}
+
+// A ROM spinning on B .
+static const word idle_rom[] = {
+    0xEAFFFFFE,  // B .
+};
+
+// Mode 4 with BG2, then palette entries and VRAM words rewritten all the time, several times per scanline
+static const word video_rom[] = {
+    0xE3A00301,  // MOV r0, #0x04000000
+    0xE3A01B01,  // MOV r1, #0x400
+    0xE3811004,  // ORR r1, r1, #4
+    0xE8800002,  // STMIA r0, {r1}
+    0xE3A02405,  // MOV r2, #0x05000000
+    0xE3A03406,  // MOV r3, #0x06000000
+    0xE3A04000,  // MOV r4, #0
+    0xE2844001,  // loop: ADD r4, r4, #1
+    0xE1A05904,  // MOV r5, r4, LSL #18
+    0xE0836825,  // ADD r6, r3, r5, LSR #16
+    0xE0847584,  // ADD r7, r4, r4, LSL #11
+    0xE0277807,  // EOR r7, r7, r7, LSL #16
+    0xE8860080,  // STMIA r6, {r7}
+    0xE2045E7F,  // AND r5, r4, #0x7F0
+    0xE0826125,  // ADD r6, r2, r5, LSR #2
+    0xE0848884,  // ADD r8, r4, r4, LSL #17
+    0xE8860100,  // STMIA r6, {r8}
+    0xEAFFFFF4,  // B loop
+};
+
+// SWI 2 (Halt) without any interrupt enabled, the CPU never wakes up
+static const word halt_rom[] = {
+    0xEF020000,  // loop: SWI 0x020000
+    0xEAFFFFFD,  // B loop
+};
+
+// A loop counting in r0
+static const word count_rom[] = {
+    0xE2800001,  // loop: ADD r0, r0, #1
+    0xEAFFFFFD,  // B loop
+};
+
+// A loop storing the same value to the same address
+static const word store_rom[] = {
+    0xE3A01402,  // MOV r1, #0x02000000
+    0xE8810001,  // loop: STMIA r1, {r0}
+    0xEAFFFFFD,  // B loop
+};
+
+static std::vector<byte> read_video() {
+    std::ifstream video(VIDEO_FILE, std::ios::in | std::ios::binary);
+    return std::vector<byte>(std::istreambuf_iterator<char>(video), std::istreambuf_iterator<char>());
+}
+
+static std::vector<byte> render(uint64_t frames, bool threaded_ppu) {
+    std::remove(VIDEO_FILE);
+    EmulatorOptions options;
+    options.headless        = true;
+    options.threaded_ppu    = threaded_ppu;
+    options.frames          = frames;
+    options.video_file      = VIDEO_FILE;
+    options.persistent_save = false;
+    {
+        Emulator emulator(ROM_FILE, options);
+        emulator.run();
+    }
+    return read_video();
+}
+
+// The render thread works from snapshots of the video memory and IO registers taken where the scanline
+// would have been rendered in place, its frames are identical to single threaded rendering
+static void test_threaded_render() {
+    static const uint64_t FRAMES = 8;
+    write_rom(video_rom, sizeof(video_rom));
+    std::vector<byte> single   = render(FRAMES, false);
+    std::vector<byte> threaded = render(FRAMES, true);
+    CHECK_EQUAL(single.size(), FRAMES * FRAME_BYTES);
+    CHECK(threaded == single);
+    // the content changes within and between frames, so the comparison covers the snapshot timing
+    if (single.size() == FRAMES * FRAME_BYTES) {
+        CHECK(!std::equal(single.begin(), single.begin() + FRAME_BYTES, single.begin() + FRAME_BYTES));
+        CHECK(!std::equal(single.begin(), single.begin() + FRAME_BYTES / 2, single.begin() + FRAME_BYTES / 2));
+    }
+}
+
+// Runs the ROM for a few frames, returns the cycles fast-forwarded as idle
+static uint64_t idle_cycles(const word* code, size_t size) {
+    static const uint64_t FRAMES = 4;
+    write_rom(code, size);
+    EmulatorOptions options;
+    options.headless        = true;
+    options.frames          = FRAMES;
+    options.persistent_save = false;
+    profiler.reset();
+    {
+        Emulator emulator(ROM_FILE, options);
+        emulator.run();
+        CHECK_EQUAL(emulator.get_frame(), FRAMES);
+    }
+    return profiler.get_calls(IDLE_SKIPPED);
+}
+
+// A loop that changes nothing, or a halt, skips to the next event: everything but the few instructions
+// run after each event to detect the loop again is skipped. A loop changing a register or writing
+// memory may be waiting on itself and runs normally.
+static void test_idle_loops() {
+    static const uint64_t CYCLES = 4 * SCANLINES * (HDRAW_CYCLES + HBLANK_CYCLES);
+    uint64_t skipped = idle_cycles(idle_rom, sizeof(idle_rom));
+    CHECK(skipped > CYCLES * 9 / 10);
+    CHECK(profiler.get_calls(IDLE_LOOP) > 0);
+    skipped = idle_cycles(halt_rom, sizeof(halt_rom));
+    CHECK(skipped > CYCLES * 9 / 10);
+    CHECK_EQUAL(profiler.get_calls(IDLE_HALT), uint64_t(1));
+    CHECK_EQUAL(idle_cycles(count_rom, sizeof(count_rom)), uint64_t(0));
+    CHECK_EQUAL(profiler.get_calls(IDLE_LOOP), uint64_t(0));
+    CHECK_EQUAL(idle_cycles(store_rom, sizeof(store_rom)), uint64_t(0));
+    CHECK_EQUAL(profiler.get_calls(IDLE_LOOP), uint64_t(0));
+}
+
+static void record() {
+    EmulatorOptions options;
+    options.headless          = true;
+    options.frames            = MOVIE_FRAMES;
+    options.record_file       = MOVIE_FILE;
+    options.keyframe_interval = KEYFRAMES;
+    options.persistent_save   = false;
+    Emulator emulator(ROM_FILE, options);
+    emulator.run();
+}
+
+// Replays from seek_frame and returns the number of frames in the video
+static uint64_t replay(uint64_t seek_frame, bool threaded_ppu) {
+    std::remove(VIDEO_FILE);
+    EmulatorOptions options;
+    options.headless     = true;
+    options.threaded_ppu = threaded_ppu;
+    options.replay_file  = MOVIE_FILE;
+    options.seek_frame   = seek_frame;
+    options.video_file   = VIDEO_FILE;
+    {
+        Emulator emulator(ROM_FILE, options);
+        emulator.run();
+        CHECK_EQUAL(emulator.get_frame(), MOVIE_FRAMES);
+    }
+    std::ifstream video(VIDEO_FILE, std::ios::in | std::ios::binary | std::ios::ate);
+    uint64_t size = video.tellg();
+    CHECK_EQUAL(size % FRAME_BYTES, uint64_t(0));
+    return size / FRAME_BYTES;
+}
+
+// --replay with --seek and --video writes the frames from the seek target to the end of the movie
+static void test_video_frames() {
+    CHECK_EQUAL(replay(0, false), MOVIE_FRAMES);
+    CHECK_EQUAL(replay(KEYFRAMES + 5, false), MOVIE_FRAMES - KEYFRAMES - 5);
+    CHECK_EQUAL(replay(MOVIE_FRAMES - 1, false), uint64_t(1));
+}
+
+// The frames replayed up to the seek target are not handed to the render thread, which is not running yet
+static void test_threaded_seek() {
+    CHECK_EQUAL(replay(KEYFRAMES + 5, true), MOVIE_FRAMES - KEYFRAMES - 5);
+    CHECK_EQUAL(replay(KEYFRAMES, true), MOVIE_FRAMES - KEYFRAMES);
+}
+
+int main() {
+    alarm(60);  // a render thread stuck on a full queue fails the test instead of hanging it
+    test_threaded_render();
+    test_idle_loops();
+    write_rom(idle_rom, sizeof(idle_rom));
+    record();
+    test_video_frames();
+    test_threaded_seek();
+    std::remove(ROM_FILE);
+    std::remove(MOVIE_FILE);
+    std::remove(VIDEO_FILE);
+    return test_result("emulator");
+}
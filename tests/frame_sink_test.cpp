@@ -0,0 +1,126 @@
+#include "../src/frame_sink.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+static const char* VIDEO_FILE = "bin/frame_sink_test.y4m";
+static const int FRAME_PIXELS = SCREEN_WIDTH * SCREEN_HEIGHT;
+
+static const halfword WHITE = 0x7FFF;
+static const halfword BLACK = 0x0000;
+static const halfword RED   = 0x001F;
+static const halfword GREEN = 0x03E0;
+static const halfword BLUE  = 0x7C00;
+
+static std::vector<byte> read_file(const char* filename) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    return std::vector<byte>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// The text up to the next newline, position moves past it
+static std::string read_line(const std::vector<byte>& data, size_t& position) {
+    std::string line;
+    while (position < data.size() && data[position] != '\n') {
+        line += char(data[position++]);
+    }
+    position++;
+    return line;
+}
+
+// Writes the frames through a sink, returns the output
+static std::vector<byte> write_frames(FRAME_FORMAT format, bool changed_only, const std::vector<std::vector<halfword>>& frames,
+                                      uint64_t* unchanged) {
+    std::remove(VIDEO_FILE);
+    {
+        FrameSink sink(format, changed_only);
+        CHECK(sink.open(VIDEO_FILE));
+        sink.start();
+        for (size_t i = 0; i < frames.size(); i++) {
+            sink.submit(frames[i].data(), i);
+        }
+        sink.stop();
+        CHECK_EQUAL(sink.get_frames_written() + sink.get_frames_unchanged(), uint64_t(frames.size()));
+        if (unchanged) *unchanged = sink.get_frames_unchanged();
+    }
+    std::vector<byte> data = read_file(VIDEO_FILE);
+    std::remove(VIDEO_FILE);
+    return data;
+}
+
+static std::vector<halfword> test_frame() {
+    std::vector<halfword> frame(FRAME_PIXELS, BLACK);
+    frame[0] = WHITE;
+    frame[1] = RED;
+    frame[2] = GREEN;
+    frame[3] = BLUE;
+    return frame;
+}
+
+// https://wiki.multimedia.cx/index.php/YUV4MPEG2
+// 4:4:4 planes in studio range BT.601, the values for the primaries match the usual tables to within one
+static void test_y4m() {
+    std::vector<byte> data = write_frames(FRAME_Y4M, false, {test_frame(), test_frame()}, nullptr);
+    size_t position        = 0;
+    CHECK_EQUAL(read_line(data, position), std::string("YUV4MPEG2 W240 H160 F16777216:280896 Ip A1:1 C444"));
+    for (int frame = 0; frame < 2; frame++) {
+        CHECK_EQUAL(read_line(data, position), std::string("FRAME"));
+        CHECK(position + 3 * FRAME_PIXELS <= data.size());
+        if (position + 3 * FRAME_PIXELS > data.size()) return;
+        const byte* y = &data[position];
+        const byte* u = y + FRAME_PIXELS;
+        const byte* v = u + FRAME_PIXELS;
+        const int expected[5][3] = {{235, 128, 128}, {82, 90, 240}, {144, 54, 34}, {41, 240, 110}, {16, 128, 128}};
+        for (int i = 0; i < 5; i++) {
+            CHECK_EQUAL(int(y[i]), expected[i][0]);
+            CHECK_EQUAL(int(u[i]), expected[i][1]);
+            CHECK_EQUAL(int(v[i]), expected[i][2]);
+        }
+        CHECK_EQUAL(int(y[FRAME_PIXELS - 1]), 16);
+        position += 3 * FRAME_PIXELS;
+    }
+    CHECK_EQUAL(position, data.size());
+}
+
+// Raw RGBA, 5 bit components have their top bits repeated in the low ones
+static void test_rgba() {
+    std::vector<byte> data = write_frames(FRAME_RGBA, false, {test_frame()}, nullptr);
+    CHECK_EQUAL(data.size(), size_t(4 * FRAME_PIXELS));
+    if (data.size() != size_t(4 * FRAME_PIXELS)) return;
+    const byte expected[4][4] = {{255, 255, 255, 255}, {255, 0, 0, 255}, {0, 255, 0, 255}, {0, 0, 255, 255}};
+    for (int i = 0; i < 4; i++) {
+        for (int c = 0; c < 4; c++) {
+            CHECK_EQUAL(int(data[4 * i + c]), int(expected[i][c]));
+        }
+    }
+}
+
+// --video-changed leaves out frames identical to the previous one, the others are tagged with their number
+static void test_changed_only() {
+    std::vector<halfword> a = test_frame();
+    std::vector<halfword> b = test_frame();
+    b[FRAME_PIXELS - 1]     = WHITE;
+    uint64_t unchanged      = 0;
+    std::vector<byte> data  = write_frames(FRAME_Y4M, true, {a, a, b, b, b, a, a}, &unchanged);
+    CHECK_EQUAL(unchanged, uint64_t(4));
+    size_t position = 0;
+    read_line(data, position);
+    for (int frame : {0, 2, 5}) {
+        CHECK_EQUAL(read_line(data, position), "FRAME Xframe=" + std::to_string(frame));
+        position += 3 * FRAME_PIXELS;
+        CHECK(position <= data.size());
+        if (position > data.size()) return;
+        CHECK_EQUAL(int(data[position - 2 * FRAME_PIXELS - 1]), frame == 2 ? 235 : 16);
+    }
+    CHECK_EQUAL(position, data.size());
+}
+
+int main() {
+    test_y4m();
+    test_rgba();
+    test_changed_only();
+    return test_result("frame_sink");
+}
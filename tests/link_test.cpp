@@ -0,0 +1,158 @@
+#include "../src/serial.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+
+static const uint64_t PERIOD = 30000;  // cycles between transfers, longer than a transfer on the cable
+
+struct LinkRun {
+    bool multiplayer;
+    uint64_t end;
+    bool delays;  // sleep at random on some syncs, the results must not depend on it
+    int seed;
+};
+
+// One unit scripted without a CPU: at k * PERIOD it sets its outgoing data, 100 cycles later the parent
+// starts transfer k. The received data and the cycle of every completed transfer go to log.
+static void run_unit(LinkCable* cable, int id, LinkRun run, std::vector<uint64_t>* log) {
+    Memory mem;
+    CPU cpu(mem);
+    Scheduler scheduler;
+    InterruptController interrupts(mem, cpu, scheduler);
+    Serial serial(mem, scheduler, interrupts);
+    serial.connect(cable, id);
+    std::mt19937 rng(run.seed * 31 + id);
+    halfword idle  = run.multiplayer ? 0x2003 : (id == 0 ? 0x1003 : 0x1000);
+    halfword start = run.multiplayer ? 0x2083 : 0x1083;
+    mem.set_halfword(IO_RAM_START + SIOCNT, idle);
+    uint64_t k = 1;
+    bool busy  = false;
+    while (scheduler.now() < run.end) {
+        uint64_t script = k * PERIOD + id * 7;
+        uint64_t kick   = k * PERIOD + 100;
+        uint64_t target = std::min(scheduler.next_event(), std::min(script > scheduler.now() ? script : kick, run.end));
+        if (target > scheduler.now()) scheduler.advance(target - scheduler.now());
+        if (scheduler.now() == script) {
+            if (run.multiplayer) {
+                mem.set_halfword(IO_RAM_START + SIOMLT_SEND, (id << 12) | k);
+            } else {
+                mem.set_word(IO_RAM_START + SIODATA32, (id << 28) | k);
+                if (id != 0) mem.set_halfword(IO_RAM_START + SIOCNT, 0x1080);
+            }
+        }
+        if (scheduler.now() == kick) {
+            if (id == 0) mem.set_halfword(IO_RAM_START + SIOCNT, start);
+            k++;
+        }
+        EVENT event;
+        uint64_t time;
+        while (scheduler.pop(event, time)) {
+            if (event == EVENT_LINK_SYNC) {
+                if (run.delays && rng() % 50 == 0) std::this_thread::sleep_for(std::chrono::microseconds(rng() % 200));
+                serial.sync(time);
+            } else if (event == EVENT_SERIAL) {
+                serial.update(time);
+            }
+        }
+        bool now_busy = mem.io_halfword(SIOCNT) & 0x80;
+        if (busy && !now_busy) {
+            uint64_t value = 0;
+            if (run.multiplayer) {
+                for (int unit = 0; unit < 4; unit++) {
+                    value = value << 16 | mem.io_halfword(SIOMULTI0 + 2 * unit);
+                }
+            } else {
+                value = mem.io_word(SIODATA32);
+            }
+            log->push_back(value);
+            log->push_back(scheduler.now());
+        }
+        busy = now_busy;
+    }
+    serial.disconnect();
+}
+
+// Runs the linked units on their own threads, returns the log of each
+static std::vector<std::vector<uint64_t>> run_linked(int units, uint64_t lookahead, LinkRun run) {
+    LinkCable cable(units, lookahead);
+    std::vector<std::vector<uint64_t>> logs(units);
+    std::vector<std::thread> threads;
+    for (int id = 0; id < units; id++) {
+        threads.emplace_back(run_unit, &cable, id, run, &logs[id]);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return logs;
+}
+
+// https://problemkaputt.de/gbatek.htm#siomultiplayermode
+// Every unit reads the SIOMLT_SEND of each unit in SIOMULTI0-3, missing units read as 0xFFFF
+static void test_multiplayer(int units) {
+    LinkRun run = {true, 3000000, false, 0};
+    std::vector<std::vector<uint64_t>> logs = run_linked(units, DEFAULT_LINK_LOOKAHEAD, run);
+    size_t transfers = logs[0].size() / 2;
+    CHECK(transfers >= 90);
+    for (int id = 0; id < units; id++) {
+        CHECK_EQUAL(logs[id].size(), logs[0].size());
+        for (size_t k = 1; k <= transfers && 2 * k <= logs[id].size(); k++) {
+            uint64_t expected = 0;
+            for (int unit = 0; unit < 4; unit++) {
+                expected = expected << 16 | (unit < units ? (unit << 12) | k : 0xFFFF);
+            }
+            CHECK_EQUAL(logs[id][2 * (k - 1)], expected);
+            CHECK_EQUAL(logs[id][2 * k - 1], logs[0][2 * k - 1]);
+        }
+    }
+}
+
+// https://problemkaputt.de/gbatek.htm#sionormalmode
+// Units 0 and 1 swap SIODATA32
+static void test_normal_32() {
+    LinkRun run = {false, 3000000, false, 0};
+    std::vector<std::vector<uint64_t>> logs = run_linked(2, DEFAULT_LINK_LOOKAHEAD, run);
+    size_t transfers = logs[0].size() / 2;
+    CHECK(transfers >= 90);
+    CHECK_EQUAL(logs[1].size(), logs[0].size());
+    for (size_t k = 1; k <= transfers && 2 * k <= logs[1].size(); k++) {
+        CHECK_EQUAL(logs[0][2 * (k - 1)], uint64_t((1 << 28) | k));
+        CHECK_EQUAL(logs[1][2 * (k - 1)], uint64_t(k));
+    }
+}
+
+// Random host delays change how far the threads get ahead of each other, never the results
+static void test_determinism() {
+    for (bool multiplayer : {true, false}) {
+        int units = multiplayer ? 4 : 2;
+        LinkRun run = {multiplayer, 3000000, true, 0};
+        std::vector<std::vector<uint64_t>> first = run_linked(units, DEFAULT_LINK_LOOKAHEAD, run);
+        for (run.seed = 1; run.seed < 4; run.seed++) {
+            CHECK(run_linked(units, DEFAULT_LINK_LOOKAHEAD, run) == first);
+        }
+    }
+}
+
+// The shortest lookahead syncs every cycle
+static void test_lookahead_1() {
+    LinkRun run = {true, 2 * PERIOD, false, 0};
+    std::vector<std::vector<uint64_t>> logs = run_linked(2, 1, run);
+    CHECK_EQUAL(logs[0].size(), size_t(2));
+    CHECK_EQUAL(logs[1].size(), size_t(2));
+    if (logs[0].size() == 2) CHECK_EQUAL(logs[0][0], uint64_t(0x00011001FFFFFFFF));
+}
+
+int main() {
+    alarm(60);  // a unit stuck syncing fails the test instead of hanging it
+    test_multiplayer(2);
+    test_multiplayer(4);
+    test_normal_32();
+    test_determinism();
+    test_lookahead_1();
+    return test_result("link");
+}
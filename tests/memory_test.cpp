@@ -0,0 +1,53 @@
+#include <vector>
+
+#include "../src/display.h"
+#include "../src/memory.h"
+
+#include "test.h"
+
+static std::vector<int> reads;
+
+static void record_read(void*, int offset) {
+    reads.push_back(offset);
+}
+
+// The status flags of DISPSTAT and the whole of VCOUNT are read only
+static void test_display_status(Memory& mem) {
+    mem.io_halfword(DISPSTAT) = 0x3;
+    mem.io_halfword(VCOUNT)   = 100;
+    mem.set_halfword(0x4000004, 0xA538);
+    CHECK_EQUAL(mem.io_halfword(DISPSTAT), halfword(0xA53B));
+    mem.set_halfword(0x4000004, 0);
+    CHECK_EQUAL(mem.io_halfword(DISPSTAT), halfword(0x3));
+    mem.set_halfword(0x4000006, 0xFFFF);
+    CHECK_EQUAL(mem.io_halfword(VCOUNT), halfword(100));
+    mem.set_word(0x4000004, 0xFFFF0038);
+    CHECK_EQUAL(mem.io_halfword(DISPSTAT), halfword(0x3B));
+    CHECK_EQUAL(mem.io_halfword(VCOUNT), halfword(100));
+    mem.set_byte(0x4000006, 0x12);
+    CHECK_EQUAL(mem.io_halfword(VCOUNT), halfword(100));
+}
+
+int main() {
+    Memory mem;
+    Display display(mem);
+    mem.set_io_read_handler(0x3FC, record_read, nullptr);
+    mem.set_io_read_handler(0x3FE, record_read, nullptr);
+
+    // Word reads at the end of the IO registers refresh the two halves of the aligned word
+    for (word address : {0x40003FC, 0x40003FD, 0x40003FE}) {
+        reads.clear();
+        mem.get_word(address);
+        CHECK_EQUAL(reads.size(), size_t(2));
+        if (reads.size() == 2) {
+            CHECK_EQUAL(reads[0], 0x3FC);
+            CHECK_EQUAL(reads[1], 0x3FE);
+        }
+    }
+    reads.clear();
+    mem.get_halfword(0x40003FE);
+    CHECK_EQUAL(reads.size(), size_t(1));
+
+    test_display_status(mem);
+    return test_result("memory");
+}
@@ -0,0 +1,139 @@
+#include "../src/soundsystem.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "../src/profiler.h"
+#include "test.h"
+
+static const word IO = 0x04000000;
+
+// Channel 2 alone at full volume on both sides
+static void play_square(Memory& mem, halfword duty, int frequency) {
+    mem.set_halfword(IO + SOUNDCNT_X, 0x80);
+    mem.set_halfword(IO + SOUNDCNT_L, 0x2277);
+    mem.set_halfword(IO + SOUNDCNT_H, 0x2);
+    mem.set_halfword(IO + SOUND2CNT_L, 0xF000 | duty << 6);
+    mem.set_halfword(IO + SOUND2CNT_H, 0x8000 | frequency);
+}
+
+// Runs ticks batches and returns the lowest and highest left output after the first batch
+static void output_range(SoundSystem& sound, int ticks, int& low, int& high) {
+    AudioRing& ring = sound.get_output();
+    AudioFrame frame;
+    while (ring.pop(frame)) {
+    }
+    low  = 32767;
+    high = -32767;
+    for (int i = 1; i <= ticks; i++) {
+        sound.tick(i * AUDIO_TICK_CYCLES);
+        while (ring.pop(frame)) {
+            if (i == 1) continue;  // interpolated from the previous output
+            low  = std::min<int>(low, frame.left);
+            high = std::max<int>(high, frame.left);
+        }
+    }
+}
+
+// https://problemkaputt.de/gbatek.htm#gbasoundchannel1tonesweep
+// Tones of half the mixing rate and above play the average level of their duty cycle, from frequency
+// 2045 their phase step does not fit 32 bits anymore
+static void test_square_frequency() {
+    Memory mem;
+    Scheduler scheduler;
+    SoundSystem sound(mem, scheduler);
+    sound.set_output_enabled(true, false);
+    int low, high;
+    play_square(mem, 2, 1750);  // 440 Hz, 50%
+    output_range(sound, 8, low, high);
+    CHECK(low < -1000);
+    CHECK(high > 1000);
+    for (int frequency : {2040, 2045, 2047}) {
+        play_square(mem, 2, frequency);
+        output_range(sound, 8, low, high);
+        CHECK_EQUAL(low, 0);
+        CHECK_EQUAL(high, 0);
+    }
+    // 12.5%, 15 * (1 - 7) / 8 = -11 before the mixer volume
+    play_square(mem, 0, 2047);
+    output_range(sound, 8, low, high);
+    CHECK(low < 0);
+    CHECK_EQUAL(high, low);
+}
+
+// Half of the wave RAM at 0xF, half at 0x0, averages to 0
+static void test_wave_frequency() {
+    Memory mem;
+    Scheduler scheduler;
+    SoundSystem sound(mem, scheduler);
+    sound.set_output_enabled(true, false);
+    for (int i = 0; i < 8; i += 2) {
+        mem.set_halfword(IO + WAVE_RAM + i, 0xFFFF);
+        mem.set_halfword(IO + WAVE_RAM + 8 + i, 0);
+    }
+    mem.set_halfword(IO + SOUNDCNT_X, 0x80);
+    mem.set_halfword(IO + SOUNDCNT_L, 0x4477);
+    mem.set_halfword(IO + SOUNDCNT_H, 0x2);
+    mem.set_halfword(IO + SOUND3CNT_L, 0x80);
+    mem.set_halfword(IO + SOUND3CNT_H, 0x2000);
+    int low, high;
+    for (int rate : {2044, 2046, 2047}) {
+        mem.set_halfword(IO + SOUND3CNT_X, 0x8000 | rate);
+        output_range(sound, 8, low, high);
+        CHECK_EQUAL(low, 0);
+        CHECK_EQUAL(high, 0);
+    }
+}
+
+// Producing more than the ring holds: a blocking output waits for a late consumer and loses nothing,
+// otherwise the frames that do not fit are dropped
+static void test_blocking_output() {
+    static const int TICKS = 400;  // 37500 output frames
+    for (bool blocking : {true, false}) {
+        Memory mem;
+        Scheduler scheduler;
+        SoundSystem sound(mem, scheduler);
+        sound.set_output_enabled(true, blocking);
+        play_square(mem, 2, 1750);
+        profiler.reset();
+        std::atomic<bool> done(false);
+        int popped = 0;
+        std::thread consumer([&] {
+            if (blocking) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            AudioFrame frame;
+            while (!done) {
+                while (blocking && sound.get_output().pop(frame)) {
+                    popped++;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            while (sound.get_output().pop(frame)) {
+                popped++;
+            }
+        });
+        for (int i = 1; i <= TICKS; i++) {
+            sound.tick(i * AUDIO_TICK_CYCLES);
+        }
+        done = true;
+        consumer.join();
+        if (blocking) {
+            CHECK(popped >= 37500);
+            CHECK_EQUAL(profiler.get_calls(AUDIO_DROPPED), uint64_t(0));
+        } else {
+            CHECK(popped < 37500);
+            CHECK(profiler.get_calls(AUDIO_DROPPED) > 0);
+        }
+    }
+}
+
+int main() {
+    alarm(60);  // a producer blocked forever fails the test instead of hanging it
+    test_square_frequency();
+    test_wave_frequency();
+    test_blocking_output();
+    return test_result("sound");
+}
@@ -0,0 +1,33 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <iostream>
+
+// Minimal checks for the programs in tests/, each one exits with the number of failed checks
+static int test_failures = 0;
+
+#define CHECK(condition)                                                               \
+    do {                                                                               \
+        if (!(condition)) {                                                            \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+            test_failures++;                                                           \
+        }                                                                              \
+    } while (0)
+
+#define CHECK_EQUAL(actual, expected)                                                                  \
+    do {                                                                                               \
+        auto a = (actual);                                                                             \
+        auto e = (expected);                                                                           \
+        if (!(a == e)) {                                                                               \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #actual " is " << std::hex << a << ", expected " \
+                      << e << std::dec << "\n";                                                        \
+            test_failures++;                                                                           \
+        }                                                                                              \
+    } while (0)
+
+static int test_result(const char* name) {
+    std::cout << name << ": " << (test_failures == 0 ? "ok" : "FAILED") << "\n";
+    return test_failures;
+}
+
+#endif
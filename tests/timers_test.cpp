@@ -0,0 +1,178 @@
+#include "../src/timers.h"
+
+#include "test.h"
+
+static const word EWRAM = 0x02000000;
+static const word IO    = 0x04000000;
+
+static const word TM0CNT_L_ADDRESS = IO + TM0CNT_L;
+static const word TM0CNT_H_ADDRESS = IO + TM0CNT_H;
+
+struct Machine {
+    Memory mem;
+    CPU cpu;
+    Scheduler scheduler;
+    InterruptController interrupts;
+    SoundSystem sound;
+    DMA dma;
+    Timers timers;
+    int irqs[4];            // timer interrupts requested so far
+    uint64_t first_irq[4];  // cycle of the first one
+
+    Machine()
+        : cpu(mem), interrupts(mem, cpu, scheduler), sound(mem, scheduler), dma(mem, scheduler, interrupts), timers(mem, scheduler, sound, dma, interrupts) {
+        for (int i = 0; i < 4; i++) {
+            irqs[i]      = 0;
+            first_irq[i] = 0;
+        }
+    }
+
+    // Advances to time, handling the timer overflows on the way as Emulator::step does
+    void run_until(uint64_t time) {
+        while (scheduler.next_event() <= time) {
+            scheduler.advance(scheduler.next_event() - scheduler.now());
+            EVENT event;
+            uint64_t when;
+            while (scheduler.pop(event, when)) {
+                if (event < EVENT_TIMER0 || event > EVENT_TIMER3) continue;
+                int i = event - EVENT_TIMER0;
+                timers.overflow(i, when);
+                if (mem.io_halfword(IF) & (1 << (IRQ_TIMER0 + i))) {
+                    if (irqs[i]++ == 0) first_irq[i] = when;
+                    mem.io_halfword(IF) &= ~(1 << (IRQ_TIMER0 + i));
+                }
+            }
+        }
+        if (time > scheduler.now()) scheduler.advance(time - scheduler.now());
+    }
+
+    halfword counter(int i) {
+        return mem.get_halfword(TM0CNT_L_ADDRESS + i * TIMER_STRIDE);
+    }
+
+    void set_timer(int i, halfword reload, halfword control) {
+        mem.set_halfword(TM0CNT_L_ADDRESS + i * TIMER_STRIDE, reload);
+        mem.set_halfword(TM0CNT_H_ADDRESS + i * TIMER_STRIDE, control);
+    }
+};
+
+// https://problemkaputt.de/gbatek.htm#gbatimers
+static void test_counter() {
+    Machine m;
+    m.set_timer(0, 0xFF00, 0x80);
+    m.run_until(0x10);
+    CHECK_EQUAL(m.counter(0), halfword(0xFF10));
+
+    // 64 cycles per tick, the counter holds between increments
+    m.set_timer(1, 0x1000, 0x81);
+    m.run_until(0x10 + 64 * 10 + 63);
+    CHECK_EQUAL(m.counter(1), halfword(0x100A));
+
+    // stopping freezes the counter, TMxCNT_L writes only set the reload value
+    m.set_timer(1, 0x2000, 0x01);
+    m.run_until(0x10000);
+    CHECK_EQUAL(m.counter(1), halfword(0x100A));
+}
+
+static void test_reload() {
+    Machine m;
+    m.set_timer(0, 0xFFF0, 0xC0);
+    m.run_until(0x10);
+    CHECK_EQUAL(m.irqs[0], 1);
+    CHECK_EQUAL(m.first_irq[0], uint64_t(0x10));
+    CHECK_EQUAL(m.counter(0), halfword(0xFFF0));
+    m.run_until(0x15);
+    CHECK_EQUAL(m.counter(0), halfword(0xFFF5));
+
+    // a new reload value takes effect from the next overflow
+    m.mem.set_halfword(TM0CNT_L_ADDRESS, 0xFF00);
+    CHECK_EQUAL(m.counter(0), halfword(0xFFF5));
+    m.run_until(0x20);
+    CHECK_EQUAL(m.counter(0), halfword(0xFF00));
+    m.run_until(0x120);
+    CHECK_EQUAL(m.irqs[0], 3);
+}
+
+// Each timer counts the overflows of the previous one, a chain runs timer 0 to timer 3
+static void test_cascade() {
+    Machine m;
+    m.set_timer(3, 0xFFFF, 0xC4);
+    m.set_timer(2, 0xFFFE, 0x84);
+    m.set_timer(1, 0xFFFF, 0x84);
+    m.set_timer(0, 0xFF00, 0x80);
+    m.run_until(256 * 2 - 1);
+    CHECK_EQUAL(m.counter(2), halfword(0xFFFF));
+    CHECK_EQUAL(m.irqs[3], 0);
+    m.run_until(256 * 2);
+    CHECK_EQUAL(m.counter(2), halfword(0xFFFE));
+    CHECK_EQUAL(m.irqs[3], 1);
+    CHECK_EQUAL(m.first_irq[3], uint64_t(256 * 2));
+    m.run_until(256 * 3);
+    CHECK_EQUAL(m.counter(2), halfword(0xFFFF));
+    m.run_until(256 * 8);
+    CHECK_EQUAL(m.irqs[3], 4);
+
+    // a cascade whose source is stopped holds its value
+    m.mem.set_halfword(TM0CNT_H_ADDRESS, 0);
+    halfword value = m.counter(2);
+    m.run_until(256 * 20);
+    CHECK_EQUAL(m.counter(2), value);
+    CHECK_EQUAL(m.irqs[3], 4);
+}
+
+// Timers 2 and 3 have no events without their interrupt, enabling it on a running timer requests it on
+// the next real overflow only
+static void test_irq_on_running_timer() {
+    Machine m;
+    m.set_timer(2, 0xFF00, 0x80);
+    m.run_until(10000);
+    m.mem.set_halfword(TM0CNT_H_ADDRESS + 2 * TIMER_STRIDE, 0xC0);
+    m.run_until(10000 + 256);
+    CHECK_EQUAL(m.irqs[2], 1);
+    CHECK_EQUAL(m.first_irq[2], uint64_t(256 * 40));
+
+    // same through a TMxCNT_L write
+    m.set_timer(3, 0xFF00, 0x80);
+    m.run_until(20000);
+    m.mem.set_halfword(TM0CNT_L_ADDRESS + 3 * TIMER_STRIDE, 0xFF00);
+    m.mem.set_halfword(TM0CNT_H_ADDRESS + 3 * TIMER_STRIDE, 0xC0);
+    m.run_until(20000 + 256);
+    CHECK_EQUAL(m.irqs[3], 1);
+    CHECK_EQUAL(m.first_irq[3], uint64_t(10256 + 256 * 39));
+}
+
+// FIFO A plays on timer 0 overflows and sound DMA1 refills it with 16 bytes once 16 or fewer are left.
+// The transfer stalls the CPU, the scheduler moves past the overflow by its cycles
+static void test_fifo_dma() {
+    Machine m;
+    for (word i = 0; i < 64; i++) {
+        m.mem.set_word(EWRAM + 4 * i, i);
+    }
+    m.mem.set_halfword(IO + SOUNDCNT_H, 0x0300);  // FIFO A on timer 0, both outputs
+    m.mem.set_word(IO + DMA0SAD + DMA_CHANNEL_STRIDE, EWRAM);
+    m.mem.set_word(IO + DMA0DAD + DMA_CHANNEL_STRIDE, IO + FIFO_A);
+    m.mem.set_halfword(IO + DMA0CNT_H + DMA_CHANNEL_STRIDE, 0xB640);  // sound FIFO, repeat, 32 bit, fixed dest
+    m.set_timer(0, 0xFFFF, 0x81);  // an overflow every 64 cycles
+    m.run_until(63);
+    CHECK_EQUAL(m.sound.fifo_size(0), 0);
+    m.run_until(64);
+    CHECK_EQUAL(m.sound.fifo_size(0), 16);
+    CHECK(m.scheduler.now() > 64);
+    m.run_until(128);
+    CHECK_EQUAL(m.sound.fifo_size(0), 31);
+    m.run_until(192);
+    CHECK_EQUAL(m.sound.fifo_size(0), 30);
+    m.run_until(64 * 16);
+    CHECK_EQUAL(m.sound.fifo_size(0), 17);
+    m.run_until(64 * 17);
+    CHECK_EQUAL(m.sound.fifo_size(0), 32);
+}
+
+int main() {
+    test_counter();
+    test_reload();
+    test_cascade();
+    test_irq_on_running_timer();
+    test_fifo_dma();
+    return test_result("timers");
+}